@@ -0,0 +1,143 @@
+/*
+ * Control of the cache state of the source and destination buffers of the
+ * copying benchmarks.
+ *
+ * The cache is prepared before every iteration and only the call itself is
+ * timed manually, as pausing and resuming the timing of the benchmark library
+ * costs far more than the mechanisms. All states are timed the same way, so
+ * they stay comparable.
+ */
+
+#include "os.hpp"
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace cache {
+
+enum State : std::int64_t {
+  /* Both buffers stay hot from the last iteration */
+  WARM,
+  /* Source flushed from all cache levels */
+  SRC_FLUSH,
+  /* Destination flushed from all cache levels */
+  DST_FLUSH,
+  /* Source and destination flushed */
+  BOTH_FLUSH,
+  /* Last-level cache evicted by touching a buffer larger than it */
+  LLC_THRASH,
+};
+
+static const char *const NAMES[] = {"warm", "src-flush", "dst-flush",
+                                    "both-flush", "llc-thrash"};
+
+/* Flushing states for benchmarks with both buffers in user space */
+static const std::vector<std::int64_t> FLUSH_ALL{WARM, SRC_FLUSH, DST_FLUSH,
+                                                 BOTH_FLUSH};
+/* Flushing states for benchmarks whose destination is only in the kernel */
+static const std::vector<std::int64_t> FLUSH_SRC{WARM, SRC_FLUSH};
+
+/*
+ * Iterations with a thrashed LLC.
+ *
+ * Thrashing takes milliseconds outside of the timed call, so the benchmark
+ * library would otherwise run millions of them to reach its minimum time.
+ */
+static const benchmark::IterationCount THRASH_ITERATIONS = 100;
+
+#if defined(__x86_64__)
+__attribute__((target("clflushopt"))) static inline void
+flush_line_opt(void const *line) {
+  _mm_clflushopt(const_cast<void *>(line));
+}
+#endif
+
+/*
+ * Write back and invalidate the cache lines of a buffer.
+ */
+static inline void flush(void const *addr, std::size_t len) {
+  auto begin =
+      reinterpret_cast<std::uintptr_t>(addr) & ~(os::CACHE_LINE_SIZE - 1);
+  auto end = reinterpret_cast<std::uintptr_t>(addr) + len;
+
+#if defined(__x86_64__)
+  static const bool opt = __builtin_cpu_supports("clflushopt");
+  for (auto line = begin; line < end; line += os::CACHE_LINE_SIZE) {
+    if (opt)
+      flush_line_opt(reinterpret_cast<void const *>(line));
+    else
+      _mm_clflush(reinterpret_cast<void const *>(line));
+  }
+  _mm_mfence();
+#elif defined(__aarch64__)
+  for (auto line = begin; line < end; line += os::CACHE_LINE_SIZE)
+    asm volatile("dc civac, %0" : : "r"(line) : "memory");
+  asm volatile("dsb ish" : : : "memory");
+#else
+#error "cache flushing is not implemented for this architecture"
+#endif
+}
+
+/*
+ * Evict the last-level cache by reading a buffer twice its size.
+ */
+static inline void thrash() {
+  static std::size_t size = 2 * os::llc_size();
+  static std::unique_ptr<char[]> buffer{new char[size]()};
+
+  std::uint64_t sum = 0;
+  for (std::size_t i = 0; i < size; i += os::CACHE_LINE_SIZE)
+    sum += buffer[i];
+  benchmark::DoNotOptimize(sum);
+}
+
+/*
+ * Brings the buffers of a benchmark into the cache state selected by the
+ * benchmark argument with index arg before every iteration and times the
+ * call.
+ *
+ * The benchmark must be registered with UseManualTime. dst may be null if the
+ * destination is not accessible from user space.
+ */
+class Preparer {
+public:
+  Preparer(benchmark::State &state, int arg, void const *src,
+           void const *dst, std::size_t len)
+      : state{state}, cache_state{static_cast<State>(state.range(arg))},
+        src{src}, dst{dst}, len{len} {
+    state.SetLabel(NAMES[cache_state]);
+  }
+
+  /*
+   * Prepare the cache and report the time of call as iteration time.
+   */
+  template <class F> void operator()(F const &call) {
+    if (cache_state == SRC_FLUSH || cache_state == BOTH_FLUSH)
+      flush(src, len);
+    if (cache_state == DST_FLUSH || cache_state == BOTH_FLUSH)
+      flush(dst, len);
+    if (cache_state == LLC_THRASH)
+      thrash();
+
+    auto start = std::chrono::steady_clock::now();
+    call();
+    auto end = std::chrono::steady_clock::now();
+    state.SetIterationTime(
+        std::chrono::duration<double>(end - start).count());
+  }
+
+private:
+  benchmark::State &state;
+  State cache_state;
+  void const *src, *dst;
+  std::size_t len;
+};
+
+} // namespace cache
@@ -0,0 +1,170 @@
+/*
+ * User-space copy kernels with the contract of the fccmp copy functions.
+ *
+ * Every kernel copies size bytes from from to the index-th DATA_SIZE-sized
+ * slot of to. They serve as baseline for the cost of the data movement
+ * without any mechanism around it.
+ */
+
+#include "fccmp.hpp"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace copy {
+
+typedef long KERNEL_TYPE(char *to, const char *from, unsigned char index,
+                         unsigned long size);
+
+/* Required alignment of to for all kernels */
+static const std::size_t ALIGN = 64;
+
+/*
+ * Copy byte by byte.
+ *
+ * The empty assembly statement keeps the compiler from vectorizing the loop
+ * or replacing it with memcpy.
+ */
+__attribute__((noinline)) static long
+scalar(char *to, const char *from, unsigned char index, unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  for (unsigned long i = 0; i < size; i++) {
+    dst[i] = from[i];
+    asm volatile("" : : : "memory");
+  }
+  return 0;
+}
+
+#if defined(__x86_64__)
+
+/*
+ * Copy with the microcoded string move instruction.
+ */
+__attribute__((noinline)) static long
+rep_movsb(char *to, const char *from, unsigned char index, unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  asm volatile("rep movsb"
+               : "+D"(dst), "+S"(from), "+c"(size)
+               :
+               : "memory");
+  return 0;
+}
+
+/*
+ * Copy the remainder after the vector loop with 8-byte and single-byte moves.
+ */
+static inline __attribute__((always_inline)) void
+copy_tail(char *dst, const char *src, unsigned long size) {
+  unsigned long i = 0;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t value;
+    std::memcpy(&value, src + i, 8);
+    std::memcpy(dst + i, &value, 8);
+  }
+  for (; i < size; i++)
+    dst[i] = src[i];
+}
+
+/*
+ * Copy the remainder after the vector loop with non-temporal 8-byte stores.
+ */
+static inline __attribute__((always_inline)) void
+stream_tail(char *dst, const char *src, unsigned long size) {
+  unsigned long i = 0;
+  for (; i + 8 <= size; i += 8) {
+    long long value;
+    std::memcpy(&value, src + i, 8);
+    _mm_stream_si64(reinterpret_cast<long long *>(dst + i), value);
+  }
+  for (; i < size; i++)
+    dst[i] = src[i];
+}
+
+__attribute__((noinline, target("sse2"))) static long
+sse2(char *to, const char *from, unsigned char index, unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  unsigned long i = 0;
+  for (; i + 16 <= size; i += 16)
+    _mm_store_si128(
+        reinterpret_cast<__m128i *>(dst + i),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(from + i)));
+  copy_tail(dst + i, from + i, size - i);
+  return 0;
+}
+
+__attribute__((noinline, target("avx2"))) static long
+avx2(char *to, const char *from, unsigned char index, unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  unsigned long i = 0;
+  for (; i + 32 <= size; i += 32)
+    _mm256_store_si256(
+        reinterpret_cast<__m256i *>(dst + i),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i)));
+  copy_tail(dst + i, from + i, size - i);
+  return 0;
+}
+
+__attribute__((noinline, target("avx2"))) static long
+avx2_nt(char *to, const char *from, unsigned char index, unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  unsigned long i = 0;
+  for (; i + 32 <= size; i += 32)
+    _mm256_stream_si256(
+        reinterpret_cast<__m256i *>(dst + i),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i)));
+  stream_tail(dst + i, from + i, size - i);
+  _mm_sfence();
+  return 0;
+}
+
+__attribute__((noinline, target("avx512f"))) static long
+avx512_nt(char *to, const char *from, unsigned char index,
+          unsigned long size) {
+  char *dst = to + index * fccmp::DATA_SIZE;
+  unsigned long i = 0;
+  for (; i + 64 <= size; i += 64)
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + i),
+                        _mm512_loadu_si512(from + i));
+  for (; i + 32 <= size; i += 32)
+    _mm256_stream_si256(
+        reinterpret_cast<__m256i *>(dst + i),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(from + i)));
+  stream_tail(dst + i, from + i, size - i);
+  _mm_sfence();
+  return 0;
+}
+
+#endif
+
+/*
+ * Copy kernel with a check whether the CPU supports it.
+ */
+struct Kernel {
+  char const *name;
+  KERNEL_TYPE *func;
+  bool (*supported)();
+};
+
+static inline bool always() { return true; }
+
+#if defined(__x86_64__)
+static const std::array<Kernel, 6> KERNELS{{
+    {"scalar", scalar, always},
+    {"rep_movsb", rep_movsb, always},
+    {"sse2", sse2, [] { return bool(__builtin_cpu_supports("sse2")); }},
+    {"avx2", avx2, [] { return bool(__builtin_cpu_supports("avx2")); }},
+    {"avx2_nt", avx2_nt, [] { return bool(__builtin_cpu_supports("avx2")); }},
+    {"avx512_nt", avx512_nt,
+     [] { return bool(__builtin_cpu_supports("avx512f")); }},
+}};
+#else
+static const std::array<Kernel, 1> KERNELS{{
+    {"scalar", scalar, always},
+}};
+#endif
+
+} // namespace copy
@@ -3,20 +3,18 @@
  */
 
 #include "fccmp.hpp"
+#include "vdso.hpp"
 #include <benchmark/benchmark.h>
 #include <fcntl.h>
 #include <iostream>
-#include <sys/auxv.h>
 #include <unistd.h>
 
 namespace fccmp {
 
-static bool vdso_initialized = false;
-
 class IOCTLFixture : public benchmark::Fixture {
 public:
   void SetUp(::benchmark::State &state) override {
-    fd = open(DEVICE_FILE, O_RDWR);
+    fd = open_device();
     if (fd < 0) {
       state.SkipWithError("Failed to open device driver!");
       return;
@@ -30,42 +28,30 @@ public:
 
 protected:
   int fccmp_ioctl(unsigned cmd, const void *args) const {
-    return ioctl(fd, cmd, args);
+    return device_ioctl(fd, cmd, args);
   }
 
 private:
   int fd;
 };
 
-template <const char *name, class F>
-class VDSOFixtureShared : public benchmark::Fixture {
+/*
+ * Fixture for the vDSO function of fccmp with the given name.
+ */
+template <const char *name> class VDSOFixture : public benchmark::Fixture {
+  static constexpr vdso::Function function = vdso::find(name);
+  static_assert(function <= vdso::FCCMP_COPY_NT,
+                "vDSO function is not supported by fccmp!");
+
 public:
   void SetUp(::benchmark::State &state) override {
-    if (!vdso_initialized)
-      vdso_init_from_sysinfo_ehdr(getauxval(AT_SYSINFO_EHDR));
-    vdso_initialized = true;
-
-    func = reinterpret_cast<F *>(vdso_sym(VDSO_VERSION, name));
+    func = vdso::get<function>();
     if (!func)
       state.SkipWithError("vDSO function not found!");
   }
 
 protected:
-  F *func;
-};
-
-template <const char *name> class VDSOFixture {
-  static_assert(name != name, "vDSO function is not supported by fccmp!");
+  typename vdso::Signature<function>::type *func;
 };
 
-template <>
-class VDSOFixture<VDSO_NOOP>
-    : public VDSOFixtureShared<VDSO_NOOP, VDSO_NOOP_TYPE> {};
-template <>
-class VDSOFixture<VDSO_COPY_ARRAY>
-    : public VDSOFixtureShared<VDSO_COPY_ARRAY, VDSO_COPY_ARRAY_TYPE> {};
-template <>
-class VDSOFixture<VDSO_COPY_NT>
-    : public VDSOFixtureShared<VDSO_COPY_NT, VDSO_COPY_NT_TYPE> {};
-
 } // namespace fccmp
@@ -16,13 +16,13 @@ template <const unsigned long type, class Arguments>
 class ExamplesFixtureShared : public benchmark::Fixture {
 public:
   void SetUp(::benchmark::State &state) override {
-    fd = open(DEVICE_FILE, O_RDONLY);
+    fd = open_device();
     if (fd < 0) {
       state.SkipWithError("Failed to open device driver!");
       return;
     }
 
-    int res = ioctl(fd, type, &args);
+    int res = register_fastcall(fd, type, &args);
     if (res < 0) {
       state.SkipWithError("ioctl failed!");
       return;
@@ -30,8 +30,7 @@ public:
   }
 
   void TearDown(::benchmark::State &) override {
-    if (args.fn_addr &&
-        munmap(reinterpret_cast<void *>(args.fn_addr), args.fn_len) < 0)
+    if (args.fn_addr && deregister_mapping(args.fn_addr, args.fn_len) < 0)
       std::cerr << "fce munmap failed!\n";
     if (fd >= 0 && close(fd) < 0)
       std::cerr << "fce close failed!\n";
@@ -0,0 +1,296 @@
+/*
+ * Cross-domain communication mechanisms of stock kernels as baselines.
+ *
+ * Every channel carries empty messages between the benchmark thread (client)
+ * and an echoing server thread, so a round trip costs two notifications and
+ * two wake-ups. io_uring is measured without a peer by submitting NOP
+ * requests.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace ipc {
+
+/* Receiving side of a message */
+enum Side { CLIENT, SERVER };
+
+static inline void check(bool ok, char const *what) {
+  if (!ok)
+    throw std::system_error{errno, std::generic_category(), what};
+}
+
+/*
+ * Futex per side, set to one while a message is pending.
+ */
+class Futex {
+public:
+  Futex() = default;
+  Futex(Futex const &) = delete;
+  Futex &operator=(Futex const &) = delete;
+
+  void send(Side to) {
+    words[to].store(1, std::memory_order_release);
+    check(futex(to, FUTEX_WAKE_PRIVATE, 1) >= 0, "futex wake failed");
+  }
+
+  void receive(Side self) {
+    while (!words[self].exchange(0, std::memory_order_acquire))
+      check(futex(self, FUTEX_WAIT_PRIVATE, 0) >= 0 || errno == EAGAIN ||
+                errno == EINTR,
+            "futex wait failed");
+  }
+
+private:
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t));
+  std::atomic<std::uint32_t> words[2]{};
+
+  long futex(Side side, int op, std::uint32_t value) {
+    return syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&words[side]),
+                   op, value, nullptr, nullptr, 0);
+  }
+};
+
+/*
+ * eventfd per side, incremented by every message.
+ */
+class Eventfd {
+public:
+  Eventfd() {
+    for (int &fd : fds)
+      check((fd = eventfd(0, EFD_CLOEXEC)) >= 0, "eventfd failed");
+  }
+  ~Eventfd() {
+    for (int fd : fds)
+      if (fd >= 0)
+        close(fd);
+  }
+  Eventfd(Eventfd const &) = delete;
+  Eventfd &operator=(Eventfd const &) = delete;
+
+  void send(Side to) {
+    std::uint64_t one = 1;
+    check(write(fds[to], &one, sizeof(one)) == sizeof(one),
+          "eventfd write failed");
+  }
+
+  void receive(Side self) {
+    std::uint64_t count;
+    check(read(fds[self], &count, sizeof(count)) == sizeof(count),
+          "eventfd read failed");
+  }
+
+private:
+  int fds[2]{-1, -1};
+};
+
+/*
+ * Pipe per side carrying one byte per message.
+ */
+class Pipe {
+public:
+  Pipe() {
+    for (auto &fd : fds)
+      check(!pipe2(fd, O_CLOEXEC), "pipe failed");
+  }
+  ~Pipe() {
+    for (auto &fd : fds)
+      for (int end : fd)
+        if (end >= 0)
+          close(end);
+  }
+  Pipe(Pipe const &) = delete;
+  Pipe &operator=(Pipe const &) = delete;
+
+  void send(Side to) {
+    char byte = 0;
+    check(write(fds[to][1], &byte, 1) == 1, "pipe write failed");
+  }
+
+  void receive(Side self) {
+    char byte;
+    check(read(fds[self][0], &byte, 1) == 1, "pipe read failed");
+  }
+
+private:
+  int fds[2][2]{{-1, -1}, {-1, -1}};
+};
+
+/*
+ * Connected pair of UNIX stream sockets carrying one byte per message.
+ */
+class Socketpair {
+public:
+  Socketpair() {
+    check(!socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds),
+          "socketpair failed");
+  }
+  ~Socketpair() {
+    for (int fd : fds)
+      if (fd >= 0)
+        close(fd);
+  }
+  Socketpair(Socketpair const &) = delete;
+  Socketpair &operator=(Socketpair const &) = delete;
+
+  /* Messages to a side are sent from the socket of the other one. */
+  void send(Side to) {
+    char byte = 0;
+    check(write(fds[to == CLIENT ? SERVER : CLIENT], &byte, 1) == 1,
+          "socket write failed");
+  }
+
+  void receive(Side self) {
+    char byte;
+    check(read(fds[self], &byte, 1) == 1, "socket read failed");
+  }
+
+private:
+  int fds[2]{-1, -1};
+};
+
+/*
+ * Client of a server thread echoing every message over a Channel.
+ */
+template <class Channel> class PingPong {
+public:
+  PingPong() : server{&PingPong::serve, this} {}
+  ~PingPong() {
+    stop.store(true);
+    channel.send(SERVER);
+    server.join();
+  }
+  PingPong(PingPong const &) = delete;
+  PingPong &operator=(PingPong const &) = delete;
+
+  void round_trip() {
+    channel.send(SERVER);
+    channel.receive(CLIENT);
+  }
+
+private:
+  Channel channel;
+  std::atomic<bool> stop{false};
+  std::thread server;
+
+  void serve() {
+    while (true) {
+      channel.receive(SERVER);
+      if (stop.load())
+        return;
+      channel.send(CLIENT);
+    }
+  }
+};
+
+/*
+ * io_uring instance set up with raw system calls, as liburing may be
+ * missing.
+ */
+class Ring {
+public:
+  explicit Ring(unsigned entries) {
+    io_uring_params params{};
+    fd = syscall(SYS_io_uring_setup, entries, &params);
+    check(fd >= 0, "io_uring_setup failed");
+
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sq_len = cq_len = std::max(sq_len, cq_len);
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+
+    sq = map(sq_len, IORING_OFF_SQ_RING);
+    cq = params.features & IORING_FEAT_SINGLE_MMAP
+             ? sq
+             : map(cq_len, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe *>(map(sqes_len, IORING_OFF_SQES));
+
+    auto sq_base = static_cast<char *>(sq);
+    sq_tail = reinterpret_cast<unsigned *>(sq_base + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq_base + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq_base + params.sq_off.array);
+
+    auto cq_base = static_cast<char *>(cq);
+    cq_head = reinterpret_cast<unsigned *>(cq_base + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq_base + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq_base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq_base + params.cq_off.cqes);
+  }
+  ~Ring() {
+    if (sqes)
+      munmap(sqes, sqes_len);
+    if (cq && cq != sq)
+      munmap(cq, cq_len);
+    if (sq)
+      munmap(sq, sq_len);
+    if (fd >= 0)
+      close(fd);
+  }
+  Ring(Ring const &) = delete;
+  Ring &operator=(Ring const &) = delete;
+
+  /*
+   * Submit count NOP requests with one io_uring_enter and reap their
+   * completions.
+   */
+  void nops(unsigned count) {
+    unsigned tail = *sq_tail;
+    for (unsigned i = 0; i < count; i++) {
+      unsigned index = (tail + i) & sq_mask;
+      std::memset(&sqes[index], 0, sizeof(io_uring_sqe));
+      sqes[index].opcode = IORING_OP_NOP;
+      sq_array[index] = index;
+    }
+    __atomic_store_n(sq_tail, tail + count, __ATOMIC_RELEASE);
+
+    check(syscall(SYS_io_uring_enter, fd, count, count,
+                  IORING_ENTER_GETEVENTS, nullptr, 0) == long{count},
+          "io_uring_enter failed");
+
+    unsigned head = *cq_head;
+    unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    if (end - head != count)
+      throw std::runtime_error{"missing io_uring completions"};
+    for (; head != end; head++)
+      if (cqes[head & cq_mask].res < 0)
+        throw std::runtime_error{"io_uring NOP failed"};
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  int fd = -1;
+  std::size_t sq_len = 0, cq_len = 0, sqes_len = 0;
+  void *sq = nullptr, *cq = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  unsigned *sq_tail, *sq_array, *cq_head, *cq_tail;
+  unsigned sq_mask, cq_mask;
+  io_uring_cqe *cqes;
+
+  void *map(std::size_t len, off_t offset) {
+    void *addr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, offset);
+    check(addr != MAP_FAILED, "io_uring mmap failed");
+    return addr;
+  }
+};
+
+/* Numbers of NOP requests submitted at once */
+static const std::vector<std::int64_t> BATCHES{1, 8, 32};
+
+} // namespace ipc
@@ -3,11 +3,17 @@
  * ioctl etc.
  */
 
+#include "cache.hpp"
 #include "config.h"
+#include "copy.hpp"
+#include "env.hpp"
 #include "fastcall.hpp"
 #include "fccmp.hpp"
 #include "fccmp_fixture.hpp"
 #include "fce_fixture.hpp"
+#include "ipc.hpp"
+#include "pages.hpp"
+#include "rpc.hpp"
 #include <benchmark/benchmark.h>
 #include <cerrno>
 #include <cstdio>
@@ -16,15 +22,19 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <string>
 #include <unistd.h>
+#include <vector>
 
 using fccmp::IOCTLFixture;
 using fccmp::NR_SYS_NI_SYSCALL;
+using fccmp::fccmp_syscall;
 using fccmp::VDSO_COPY_ARRAY;
 using fccmp::VDSO_COPY_NT;
 using fccmp::VDSO_NOOP;
 using fccmp::VDSOFixture;
 using fce::ExamplesFixture;
+using rpc::RPCFixture;
 
 static const unsigned long MAGIC = 0xBEEF;
 static const char MAGIC_CHAR = 0xAB;
@@ -33,6 +43,36 @@ static const unsigned char MAGIC_INDEX =
 static const char CHAR_SEQUENCE[fccmp::DATA_SIZE] = {MAGIC_CHAR};
 static const std::size_t AVX_ALIGN = 32;
 
+/*
+ * Sizes of the copying benchmarks combined with cache states, which are timed
+ * manually by cache::Preparer.
+ */
+static void sized(benchmark::internal::Benchmark *benchmark,
+                  std::vector<std::int64_t> const &states) {
+  benchmark
+      ->ArgsProduct(
+          {benchmark::CreateDenseRange(0, fccmp::DATA_SIZE, ARRAY_STEP),
+           states})
+      ->ArgNames({"size", "cache"})
+      ->UseManualTime();
+}
+
+/* Flushing states if source and destination are in user space */
+static void sized_flush_all(benchmark::internal::Benchmark *benchmark) {
+  sized(benchmark, cache::FLUSH_ALL);
+}
+
+/* Flushing states if only the source is in user space */
+static void sized_flush_src(benchmark::internal::Benchmark *benchmark) {
+  sized(benchmark, cache::FLUSH_SRC);
+}
+
+/* Thrashed LLC, registered separately for the fixed iteration count */
+static void sized_thrash(benchmark::internal::Benchmark *benchmark) {
+  sized(benchmark, {cache::LLC_THRASH});
+  benchmark->Iterations(cache::THRASH_ITERATIONS);
+}
+
 /*
  * Benchmark the execution of an empty system call by using sys_ni_syscall,
  * the handler for empty system calls.
@@ -53,34 +93,69 @@ BENCHMARK(syscall_sys_ni_syscall);
  * Benchmark the array-copying system call provided by fccmp.
  */
 static void syscall_array(benchmark::State &state) {
-  unsigned char size = static_cast<unsigned char>(state.range());
+  unsigned char size = static_cast<unsigned char>(state.range(0));
 
-  int err = syscall(fccmp::NR_ARRAY, CHAR_SEQUENCE, MAGIC_INDEX, size);
+  int err = fccmp_syscall(fccmp::NR_ARRAY, CHAR_SEQUENCE, MAGIC_INDEX, size);
   if (err < 0) {
     state.SkipWithError("system call failed!");
     return;
   }
 
-  for (auto _ : state)
-    syscall(fccmp::NR_ARRAY, CHAR_SEQUENCE, MAGIC_INDEX, size);
+  cache::Preparer measure{state, 1, CHAR_SEQUENCE, nullptr, size};
+  for (auto _ : state) {
+    measure([&] {
+      fccmp_syscall(fccmp::NR_ARRAY, CHAR_SEQUENCE, MAGIC_INDEX, size);
+    });
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK(syscall_array)->Apply(sized_flush_src);
+BENCHMARK(syscall_array)->Apply(sized_thrash);
+
+/*
+ * Benchmark the array-copying system call with the source spread over pages.
+ */
+static void syscall_array_spread(benchmark::State &state) {
+  pages::Arena src{static_cast<std::size_t>(state.range(0)),
+                   static_cast<pages::Backing>(state.range(1)), MAGIC_CHAR};
+  pages::Cursor cursor{src.get_count()};
+
+  int err = fccmp_syscall(fccmp::NR_ARRAY, src.slot(0, 0), 0, fccmp::DATA_SIZE);
+  if (err < 0) {
+    state.SkipWithError("system call failed!");
+    return;
+  }
+
+  state.SetLabel(src.get_kind());
+  pages::TLBCounter tlb{state};
+  if (state.error_occurred())
+    return;
+  tlb.start(state);
+  for (auto _ : state) {
+    fccmp_syscall(fccmp::NR_ARRAY, src.slot(cursor.page, cursor.slot),
+                  cursor.slot, fccmp::DATA_SIZE);
+    cursor.next();
+  }
+  tlb.stop(state);
 
-  state.SetBytesProcessed(state.iterations() * state.range());
+  state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
 }
-BENCHMARK(syscall_array)->DenseRange(0, fccmp::DATA_SIZE, ARRAY_STEP);
+BENCHMARK(syscall_array_spread)->Apply(pages::spread);
 
 /*
  * Benchmark the array-copying system call with a non-temporal hint provided by
  * fccmp.
  */
 static void syscall_nt(benchmark::State &state) {
-  int err = syscall(fccmp::NR_NT, CHAR_SEQUENCE, MAGIC_INDEX);
+  int err = fccmp_syscall(fccmp::NR_NT, CHAR_SEQUENCE, MAGIC_INDEX);
   if (err < 0) {
     state.SkipWithError("system call failed!");
     return;
   }
 
   for (auto _ : state)
-    syscall(fccmp::NR_NT, CHAR_SEQUENCE, MAGIC_INDEX);
+    fccmp_syscall(fccmp::NR_NT, CHAR_SEQUENCE, MAGIC_INDEX);
 
   state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
 }
@@ -112,7 +187,7 @@ BENCHMARK_DEFINE_F(IOCTLFixture, ioctl_array)
   if (state.error_occurred())
     return;
 
-  unsigned char size = static_cast<unsigned char>(state.range());
+  unsigned char size = static_cast<unsigned char>(state.range(0));
   struct fccmp::array_args args {
     CHAR_SEQUENCE, MAGIC_INDEX, size
   };
@@ -123,13 +198,53 @@ BENCHMARK_DEFINE_F(IOCTLFixture, ioctl_array)
     return;
   }
 
-  for (auto _ : state)
+  cache::Preparer measure{state, 1, CHAR_SEQUENCE, nullptr, size};
+  for (auto _ : state) {
+    measure([&] { fccmp_ioctl(fccmp::IOCTL_ARRAY, &args); });
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_REGISTER_F(IOCTLFixture, ioctl_array)->Apply(sized_flush_src);
+BENCHMARK_REGISTER_F(IOCTLFixture, ioctl_array)->Apply(sized_thrash);
+
+/*
+ * Benchmark the array-copying ioctl handler with the source spread over pages.
+ */
+BENCHMARK_DEFINE_F(IOCTLFixture, ioctl_array_spread)
+(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  pages::Arena src{static_cast<std::size_t>(state.range(0)),
+                   static_cast<pages::Backing>(state.range(1)), MAGIC_CHAR};
+  pages::Cursor cursor{src.get_count()};
+  struct fccmp::array_args args {
+    src.slot(0, 0), 0, fccmp::DATA_SIZE
+  };
+
+  int result = fccmp_ioctl(fccmp::IOCTL_ARRAY, &args);
+  if (result != 0) {
+    state.SkipWithError("ioctl failed!");
+    return;
+  }
+
+  state.SetLabel(src.get_kind());
+  pages::TLBCounter tlb{state};
+  if (state.error_occurred())
+    return;
+  tlb.start(state);
+  for (auto _ : state) {
+    args.data = src.slot(cursor.page, cursor.slot);
+    args.index = cursor.slot;
     fccmp_ioctl(fccmp::IOCTL_ARRAY, &args);
+    cursor.next();
+  }
+  tlb.stop(state);
 
-  state.SetBytesProcessed(state.iterations() * state.range());
+  state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
 }
-BENCHMARK_REGISTER_F(IOCTLFixture, ioctl_array)
-    ->DenseRange(0, fccmp::DATA_SIZE, ARRAY_STEP);
+BENCHMARK_REGISTER_F(IOCTLFixture, ioctl_array_spread)->Apply(pages::spread);
 
 /*
  * Benchmark the array-copying ioctl handler with a non-temporal hint provided
@@ -181,26 +296,69 @@ BENCHMARK_TEMPLATE_DEFINE_F(VDSOFixture, vdso_copy_array, VDSO_COPY_ARRAY)
   if (state.error_occurred())
     return;
 
-  std::unique_ptr<char> to{new char[fccmp::ARRAY_LENGTH * fccmp::DATA_SIZE]};
+  std::unique_ptr<char[]> to{
+      new char[fccmp::ARRAY_LENGTH * fccmp::DATA_SIZE]};
 
-  if (func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, state.range())) {
+  std::size_t size = state.range(0);
+  if (func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, size)) {
     state.SkipWithError("Unexpected vDSO function return value!");
     return;
   }
 
   char *dst = to.get() + MAGIC_INDEX * fccmp::DATA_SIZE;
-  if (std::memcmp(dst, CHAR_SEQUENCE, state.range()) != 0) {
+  if (std::memcmp(dst, CHAR_SEQUENCE, size) != 0) {
     state.SkipWithError("Data not copied correctly!");
     return;
   }
 
-  for (auto _ : state)
-    func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, state.range());
+  cache::Preparer measure{state, 1, CHAR_SEQUENCE, dst, size};
+  for (auto _ : state) {
+    measure([&] { func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, size); });
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_REGISTER_F(VDSOFixture, vdso_copy_array)->Apply(sized_flush_all);
+BENCHMARK_REGISTER_F(VDSOFixture, vdso_copy_array)->Apply(sized_thrash);
+
+/*
+ * Benchmark the array copy vDSO function with source and destination spread
+ * over pages.
+ */
+BENCHMARK_TEMPLATE_DEFINE_F(VDSOFixture, vdso_copy_array_spread,
+                            VDSO_COPY_ARRAY)
+(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  auto count = static_cast<std::size_t>(state.range(0));
+  auto backing = static_cast<pages::Backing>(state.range(1));
+  pages::Arena src{count, backing, MAGIC_CHAR};
+  pages::Arena dst{count, backing};
+  pages::Cursor cursor{count};
+
+  if (func(dst.page(0), src.slot(0, 0), 0, fccmp::DATA_SIZE) ||
+      std::memcmp(dst.slot(0, 0), src.slot(0, 0), fccmp::DATA_SIZE) != 0) {
+    state.SkipWithError("Data not copied correctly!");
+    return;
+  }
+
+  state.SetLabel(src.get_kind());
+  pages::TLBCounter tlb{state};
+  if (state.error_occurred())
+    return;
+  tlb.start(state);
+  for (auto _ : state) {
+    func(dst.page(cursor.page), src.slot(cursor.page, cursor.slot),
+         cursor.slot, fccmp::DATA_SIZE);
+    cursor.next();
+  }
+  tlb.stop(state);
 
-  state.SetBytesProcessed(state.iterations() * state.range());
+  state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
 }
-BENCHMARK_REGISTER_F(VDSOFixture, vdso_copy_array)
-    ->DenseRange(0, fccmp::DATA_SIZE, ARRAY_STEP);
+BENCHMARK_REGISTER_F(VDSOFixture, vdso_copy_array_spread)
+    ->Apply(pages::spread);
 
 /*
  * Benchmark the execution of the non-temporal copy vDSO function provided by
@@ -232,6 +390,84 @@ BENCHMARK_TEMPLATE_F(VDSOFixture, vdso_copy_nt, VDSO_COPY_NT)
   state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
 }
 
+/*
+ * Benchmark a user-space copy kernel with the contract of vdso_copy_array as
+ * baseline for the data movement alone.
+ */
+static void copy_kernel(benchmark::State &state, copy::Kernel const &kernel) {
+  if (!kernel.supported()) {
+    state.SkipWithError("Copy kernel not supported by the CPU!");
+    return;
+  }
+
+  char *to_ptr = static_cast<char *>(
+      std::aligned_alloc(copy::ALIGN, fccmp::ARRAY_LENGTH * fccmp::DATA_SIZE));
+  std::unique_ptr<char, decltype(std::free) *> to{to_ptr, std::free};
+
+  std::size_t size = state.range(0);
+  kernel.func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, size);
+  char *dst = to.get() + MAGIC_INDEX * fccmp::DATA_SIZE;
+  if (std::memcmp(dst, CHAR_SEQUENCE, size) != 0) {
+    state.SkipWithError("Data not copied correctly!");
+    return;
+  }
+
+  cache::Preparer measure{state, 1, CHAR_SEQUENCE, dst, size};
+  for (auto _ : state) {
+    measure([&] { kernel.func(to.get(), CHAR_SEQUENCE, MAGIC_INDEX, size); });
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+/*
+ * Benchmark a user-space copy kernel with source and destination spread over
+ * pages as baseline for vdso_copy_array_spread.
+ */
+static void copy_kernel_spread(benchmark::State &state,
+                               copy::Kernel const &kernel) {
+  if (!kernel.supported()) {
+    state.SkipWithError("Copy kernel not supported by the CPU!");
+    return;
+  }
+
+  auto count = static_cast<std::size_t>(state.range(0));
+  auto backing = static_cast<pages::Backing>(state.range(1));
+  pages::Arena src{count, backing, MAGIC_CHAR};
+  pages::Arena dst{count, backing};
+  pages::Cursor cursor{count};
+
+  state.SetLabel(src.get_kind());
+  pages::TLBCounter tlb{state};
+  if (state.error_occurred())
+    return;
+  tlb.start(state);
+  for (auto _ : state) {
+    kernel.func(dst.page(cursor.page), src.slot(cursor.page, cursor.slot),
+                cursor.slot, fccmp::DATA_SIZE);
+    cursor.next();
+  }
+  tlb.stop(state);
+
+  state.SetBytesProcessed(state.iterations() * fccmp::DATA_SIZE);
+}
+
+/*
+ * Register the copy kernels for the same sizes as the copying functions.
+ */
+static void register_copy_kernels() {
+  for (auto const &kernel : copy::KERNELS) {
+    auto name = std::string{"copy_"} + kernel.name;
+    benchmark::RegisterBenchmark(name.c_str(), copy_kernel, kernel)
+        ->Apply(sized_flush_all);
+    benchmark::RegisterBenchmark(name.c_str(), copy_kernel, kernel)
+        ->Apply(sized_thrash);
+    benchmark::RegisterBenchmark((name + "_spread").c_str(),
+                                 copy_kernel_spread, kernel)
+        ->Apply(pages::spread);
+  }
+}
+
 /*
  * Benchmark the default no-operation fastcall function
  * available to any process.
@@ -308,25 +544,32 @@ BENCHMARK_TEMPLATE_DEFINE_F(ExamplesFixture, fastcall_examples_array,
   if (state.error_occurred())
     return;
 
-  if (fastcall(0, state.range()) != 0) {
+  auto size = state.range(0);
+  if (fastcall(0, size) != 0) {
     state.SkipWithError("system call failed!");
     return;
   }
 
-  memset(args.shared_addr, MAGIC, state.range());
+  memset(args.shared_addr, MAGIC, size);
 
-  for (auto _ : state)
-    fastcall(MAGIC % fce::DATA_SIZE, state.range());
+  cache::Preparer measure{state, 1, args.shared_addr, nullptr,
+                          static_cast<std::size_t>(size)};
+  for (auto _ : state) {
+    measure([&] { fastcall(MAGIC % fce::DATA_SIZE, size); });
+  }
 
-  state.SetBytesProcessed(state.iterations() * state.range());
+  state.SetBytesProcessed(state.iterations() * size);
 }
 BENCHMARK_REGISTER_F(ExamplesFixture, fastcall_examples_array)
-    ->DenseRange(0, fce::DATA_SIZE, ARRAY_STEP);
+    ->Apply(sized_flush_src);
+BENCHMARK_REGISTER_F(ExamplesFixture, fastcall_examples_array)
+    ->Apply(sized_thrash);
 
 /*
  * Benchmark the array_nt fastcall function of fastcall-examples.
  */
-BENCHMARK_TEMPLATE_F(ExamplesFixture, fastcall_examples_nt, fce::IOCTL_NT)
+BENCHMARK_TEMPLATE_DEFINE_F(ExamplesFixture, fastcall_examples_nt,
+                            fce::IOCTL_NT)
 (benchmark::State &state) {
   if (state.error_occurred())
     return;
@@ -338,10 +581,173 @@ BENCHMARK_TEMPLATE_F(ExamplesFixture, fastcall_examples_nt, fce::IOCTL_NT)
 
   memset(args.shared_addr, MAGIC, fce::DATA_SIZE);
 
-  for (auto _ : state)
-    fastcall(MAGIC % fce::ARRAY_SIZE);
+  cache::Preparer measure{state, 0, args.shared_addr, nullptr, fce::DATA_SIZE};
+  for (auto _ : state) {
+    measure([&] { fastcall(MAGIC % fce::ARRAY_SIZE); });
+  }
 
   state.SetBytesProcessed(state.iterations() * fce::DATA_SIZE);
 }
+BENCHMARK_REGISTER_F(ExamplesFixture, fastcall_examples_nt)
+    ->ArgsProduct({cache::FLUSH_SRC})
+    ->ArgName("cache")
+    ->UseManualTime();
+BENCHMARK_REGISTER_F(ExamplesFixture, fastcall_examples_nt)
+    ->Arg(cache::LLC_THRASH)
+    ->ArgName("cache")
+    ->UseManualTime()
+    ->Iterations(cache::THRASH_ITERATIONS);
+
+/*
+ * Benchmark a round trip to a server thread over an IPC channel.
+ *
+ * The client blocks while the server runs, so the wall-clock time is used.
+ */
+template <class Channel> static void ipc_round_trip(benchmark::State &state) {
+  std::unique_ptr<ipc::PingPong<Channel>> ping_pong;
+  try {
+    ping_pong.reset(new ipc::PingPong<Channel>{});
+  } catch (std::system_error const &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+
+  for (auto _ : state)
+    ping_pong->round_trip();
+}
+BENCHMARK_TEMPLATE(ipc_round_trip, ipc::Futex)->UseRealTime();
+BENCHMARK_TEMPLATE(ipc_round_trip, ipc::Eventfd)->UseRealTime();
+BENCHMARK_TEMPLATE(ipc_round_trip, ipc::Pipe)->UseRealTime();
+BENCHMARK_TEMPLATE(ipc_round_trip, ipc::Socketpair)->UseRealTime();
+
+/*
+ * Benchmark the submission and completion of io_uring NOP requests, batch
+ * requests per io_uring_enter.
+ */
+static void io_uring_nop(benchmark::State &state) {
+  auto batch = static_cast<unsigned>(state.range(0));
+  std::unique_ptr<ipc::Ring> ring;
+  try {
+    ring.reset(new ipc::Ring{batch});
+    ring->nops(batch);
+  } catch (std::exception const &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+
+  for (auto _ : state)
+    ring->nops(batch);
+
+  state.SetItemsProcessed(state.iterations() * batch);
+}
+BENCHMARK(io_uring_nop)->ArgsProduct({ipc::BATCHES})->ArgName("batch");
+
+/*
+ * Benchmark the noop operation of the spin-polling RPC server.
+ */
+BENCHMARK_F(RPCFixture, rpc_noop)(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  if (server->call(rpc::NOOP) != 0) {
+    state.SkipWithError("RPC failed!");
+    return;
+  }
+
+  for (auto _ : state)
+    server->call(rpc::NOOP);
+}
+
+/*
+ * Benchmark the stack operation of the spin-polling RPC server.
+ */
+BENCHMARK_F(RPCFixture, rpc_stack)(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  if (server->call(rpc::STACK, MAGIC) != static_cast<long>(MAGIC)) {
+    state.SkipWithError("RPC failed!");
+    return;
+  }
+
+  for (auto _ : state)
+    server->call(rpc::STACK, MAGIC);
+}
+
+/*
+ * Benchmark the priv operation of the spin-polling RPC server.
+ */
+BENCHMARK_F(RPCFixture, rpc_priv)(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  if (server->call(rpc::PRIV, MAGIC) != static_cast<long>(MAGIC + 1)) {
+    state.SkipWithError("RPC failed!");
+    return;
+  }
+
+  for (auto _ : state)
+    server->call(rpc::PRIV, MAGIC);
+}
 
-BENCHMARK_MAIN();
+/*
+ * Benchmark the array operation of the spin-polling RPC server.
+ */
+BENCHMARK_DEFINE_F(RPCFixture, rpc_array)(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  auto size = state.range(0);
+  if (server->call(rpc::ARRAY, 0, size) != 0) {
+    state.SkipWithError("RPC failed!");
+    return;
+  }
+
+  memset(server->get_shared(), MAGIC, size);
+
+  cache::Preparer measure{state, 1, server->get_shared(), nullptr,
+                          static_cast<std::size_t>(size)};
+  for (auto _ : state) {
+    measure([&] { server->call(rpc::ARRAY, MAGIC % fce::ARRAY_SIZE, size); });
+  }
+
+  state.SetBytesProcessed(state.iterations() * size);
+}
+BENCHMARK_REGISTER_F(RPCFixture, rpc_array)->Apply(sized_flush_src);
+BENCHMARK_REGISTER_F(RPCFixture, rpc_array)->Apply(sized_thrash);
+
+/*
+ * Benchmark the throughput of the spin-polling RPC server with depth noop
+ * requests in flight.
+ */
+BENCHMARK_DEFINE_F(RPCFixture, rpc_noop_pipelined)
+(benchmark::State &state) {
+  if (state.error_occurred())
+    return;
+
+  auto depth = state.range(0);
+  for (auto _ : state) {
+    for (std::int64_t i = 0; i < depth; i++)
+      server->submit({rpc::NOOP, 0, 0, 0});
+    for (std::int64_t i = 0; i < depth; i++)
+      server->complete();
+  }
+
+  state.SetItemsProcessed(state.iterations() * depth);
+}
+BENCHMARK_REGISTER_F(RPCFixture, rpc_noop_pipelined)
+    ->ArgsProduct({rpc::DEPTHS})
+    ->ArgName("depth");
+
+int main(int argc, char **argv) {
+  register_copy_kernels();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    return 1;
+  benchmark::AddCustomContext("backend", fce::BACKEND);
+  for (auto const &[key, value] : env::fingerprint())
+    benchmark::AddCustomContext(key, value);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
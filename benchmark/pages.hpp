@@ -0,0 +1,250 @@
+/*
+ * User buffers spread over many pages, optionally backed by huge pages.
+ *
+ * Consecutive iterations of a spreading benchmark access a different page and
+ * a different DATA_SIZE-sized slot within it, so the TLB is exercised instead
+ * of hitting a single warm page. The dTLB misses of the measured loop are
+ * reported as counters if the PMU provides them.
+ */
+
+#include "fccmp.hpp"
+#include "perf.hpp"
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace pages {
+
+enum Backing : std::int64_t {
+  /* Pages of the base page size */
+  BASE,
+  /* hugetlbfs pages if reserved, otherwise transparent huge pages */
+  HUGE,
+};
+
+/* Numbers of pages the accesses are spread over */
+static const std::vector<std::int64_t> COUNTS{1, 16, 256, 4096};
+
+/* PMD-level huge page size on x86-64 and arm64 with 4 KiB base pages */
+static const std::size_t DEFAULT_HUGE_PAGE_SIZE = 2 << 20;
+
+static inline std::size_t page_size() {
+  static const std::size_t size = getpagesize();
+  return size;
+}
+
+/*
+ * Return the size of a PMD-level huge page as reported by the kernel, or
+ * DEFAULT_HUGE_PAGE_SIZE if it is not available.
+ */
+static inline std::size_t huge_page_size() {
+  static const std::size_t size = [] {
+    std::ifstream file{"/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"};
+    std::size_t value = 0;
+    if (file >> value && value)
+      return value;
+    return DEFAULT_HUGE_PAGE_SIZE;
+  }();
+  return size;
+}
+
+/*
+ * Return whether the mapping starting at addr contains transparent huge pages
+ * according to /proc/self/smaps.
+ */
+static inline bool has_thp(void const *addr) {
+  std::ifstream smaps{"/proc/self/smaps"};
+  char start[2 * sizeof(void *) + 2];
+  std::snprintf(start, sizeof(start), "%lx-",
+                reinterpret_cast<unsigned long>(addr));
+
+  std::string line;
+  bool found = false;
+  while (std::getline(smaps, line)) {
+    if (line.rfind(start, 0) == 0)
+      found = true;
+    else if (found && line.rfind("AnonHugePages:", 0) == 0)
+      return std::stoul(line.substr(line.find(':') + 1)) > 0;
+  }
+  return false;
+}
+
+/*
+ * Buffer of count base-size pages, filled with value.
+ */
+class Arena {
+public:
+  Arena(std::size_t count, Backing backing, char value = 0) : count{count} {
+    len = count * page_size();
+
+    if (backing == HUGE)
+      map_huge();
+    if (!base) {
+      base = map(len, 0);
+      kind = "base";
+    }
+
+    // Fault in all pages before measuring
+    std::memset(base, value, len);
+
+    if (kind == std::string{"thp"} && !has_thp(base))
+      kind = "base";
+  }
+  ~Arena() { munmap(mapping, mapping_len); }
+  Arena(Arena const &) = delete;
+  Arena &operator=(Arena const &) = delete;
+
+  std::size_t get_count() const { return count; }
+
+  /* Memory which actually backs the arena: hugetlb, thp or base */
+  char const *get_kind() const { return kind; }
+
+  char *page(std::size_t index) const { return base + index * page_size(); }
+
+  char *slot(std::size_t index, unsigned char slot) const {
+    return page(index) + slot * fccmp::DATA_SIZE;
+  }
+
+private:
+  std::size_t count, len;
+  char *base = nullptr, *mapping = nullptr;
+  std::size_t mapping_len = 0;
+  char const *kind = nullptr;
+
+  char *map(std::size_t size, int flags) {
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (addr == MAP_FAILED) {
+      if (flags)
+        return nullptr;
+      throw std::system_error{errno, std::generic_category(),
+                              "cannot map arena"};
+    }
+
+    mapping = static_cast<char *>(addr);
+    mapping_len = size;
+    return mapping;
+  }
+
+  void map_huge() {
+    std::size_t huge = huge_page_size();
+    std::size_t huge_len = (len + huge - 1) / huge * huge;
+
+    if ((base = map(huge_len, MAP_HUGETLB))) {
+      kind = "hugetlb";
+      return;
+    }
+
+    // Align to a huge page so that khugepaged is not needed.
+    map(huge_len + huge, 0);
+    auto addr = reinterpret_cast<std::uintptr_t>(mapping);
+    base = reinterpret_cast<char *>((addr + huge - 1) & ~(huge - 1));
+    kind = madvise(base, huge_len, MADV_HUGEPAGE) ? "base" : "thp";
+  }
+};
+
+/*
+ * Position of the next access, advancing the page and the slot within the
+ * page with every iteration.
+ */
+struct Cursor {
+  std::size_t pages;
+  std::size_t page = 0;
+  unsigned char slot = 0;
+
+  void next() {
+    if (++page == pages)
+      page = 0;
+    if (++slot == fccmp::ARRAY_LENGTH)
+      slot = 0;
+  }
+};
+
+/* Events counted around the measured loop */
+static const std::array<char const *, 2> TLB_EVENTS{"dTLB-load-misses",
+                                                    "dTLB-store-misses"};
+
+/*
+ * Counts dTLB misses of the benchmark thread, including those in the kernel.
+ *
+ * Events not supported by the PMU are left out of the results. The events
+ * are pinned, so if one of them cannot be scheduled on the PMU, its reads
+ * fail and the benchmark is skipped with an error instead. Callers must check
+ * state.error_occurred() after construction.
+ */
+class TLBCounter {
+public:
+  explicit TLBCounter(benchmark::State &state) {
+    for (std::size_t i = 0; i < TLB_EVENTS.size(); i++) {
+      try {
+        fds[i] = perf::open_event(perf::find_event(TLB_EVENTS[i]), -1);
+      } catch (std::system_error const &) {
+        fds[i] = -1;
+      }
+    }
+
+    // Detect unschedulable events before the measurement starts.
+    read(state, before);
+  }
+  ~TLBCounter() {
+    for (int fd : fds)
+      if (fd >= 0)
+        close(fd);
+  }
+  TLBCounter(TLBCounter const &) = delete;
+  TLBCounter &operator=(TLBCounter const &) = delete;
+
+  void start(benchmark::State &state) { read(state, before); }
+
+  /*
+   * Add the misses since start() per iteration to the counters of state.
+   */
+  void stop(benchmark::State &state) {
+    std::array<std::uint64_t, TLB_EVENTS.size()> after{};
+    if (!read(state, after))
+      return;
+
+    for (std::size_t i = 0; i < TLB_EVENTS.size(); i++)
+      if (fds[i] >= 0)
+        state.counters[TLB_EVENTS[i]] =
+            benchmark::Counter(static_cast<double>(after[i] - before[i]),
+                               benchmark::Counter::kAvgIterations);
+  }
+
+private:
+  std::array<int, TLB_EVENTS.size()> fds;
+  std::array<std::uint64_t, TLB_EVENTS.size()> before{};
+
+  bool read(benchmark::State &state,
+            std::array<std::uint64_t, TLB_EVENTS.size()> &counts) {
+    try {
+      for (std::size_t i = 0; i < TLB_EVENTS.size(); i++)
+        if (fds[i] >= 0)
+          perf::read_group(fds[i], &counts[i], 1);
+    } catch (std::runtime_error const &) {
+      state.SkipWithError("cannot read dTLB counters!");
+      return false;
+    }
+    return true;
+  }
+};
+
+/*
+ * Spread counts combined with both backings.
+ */
+static inline void spread(benchmark::internal::Benchmark *benchmark) {
+  benchmark->ArgsProduct({COUNTS, {BASE, HUGE}})
+      ->ArgNames({"pages", "huge"});
+}
+
+} // namespace pages
@@ -0,0 +1,309 @@
+/*
+ * Spin-polling RPC to a server thread over shared memory as user-space upper
+ * bound for calls into another protection domain.
+ *
+ * Client and server poll a pair of lock-free single-producer single-consumer
+ * rings on dedicated CPUs, so no system call or wake-up is involved. The
+ * server performs the same operations as the fastcall-examples functions.
+ *
+ * The CPUs are selected with the environment variables RPC_CLIENT_CPU and
+ * RPC_SERVER_CPU, e.g. SMT siblings or CPUs on different sockets. By default,
+ * the client stays on its current CPU and the server uses another allowed
+ * one.
+ */
+
+#include "fastcall.hpp"
+#include "os.hpp"
+#include <algorithm>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <optional>
+#include <sched.h>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace rpc {
+
+static const std::size_t CACHE_LINE = 64;
+/* Number of messages per ring, a power of two */
+static const std::size_t RING_SIZE = 64;
+
+/* Numbers of requests in flight for the throughput benchmark */
+static const std::vector<std::int64_t> DEPTHS{1, 8, 32};
+
+enum Op : unsigned {
+  NOOP,
+  STACK,
+  PRIV,
+  ARRAY,
+  /* Terminates the server */
+  STOP,
+};
+
+/*
+ * Request or response, a cache line each.
+ */
+struct alignas(CACHE_LINE) Message {
+  Op op;
+  unsigned long arg0, arg1;
+  long result;
+};
+
+/* Hint to the CPU that this is a spin-wait loop. */
+static inline void relax() {
+#if defined(__x86_64__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" : : : "memory");
+#endif
+}
+
+/*
+ * Lock-free single-producer single-consumer ring.
+ *
+ * The indices of both sides are on their own cache lines together with the
+ * copy of the other index last seen, so the shared lines only move when the
+ * cached index is exhausted.
+ */
+class Ring {
+public:
+  bool push(Message const &message) {
+    std::size_t tail = producer.index.load(std::memory_order_relaxed);
+    if (tail - producer.cached == RING_SIZE) {
+      producer.cached = consumer.index.load(std::memory_order_acquire);
+      if (tail - producer.cached == RING_SIZE)
+        return false;
+    }
+
+    slots[tail % RING_SIZE] = message;
+    producer.index.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(Message &message) {
+    std::size_t head = consumer.index.load(std::memory_order_relaxed);
+    if (head == consumer.cached) {
+      consumer.cached = producer.index.load(std::memory_order_acquire);
+      if (head == consumer.cached)
+        return false;
+    }
+
+    message = slots[head % RING_SIZE];
+    consumer.index.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct alignas(CACHE_LINE) Side {
+    std::atomic<std::size_t> index{0};
+    /* Index of the other side */
+    std::size_t cached = 0;
+  };
+
+  Side producer, consumer;
+  Message slots[RING_SIZE];
+};
+
+/*
+ * Return the CPU given by an environment variable, if set.
+ */
+static inline std::optional<unsigned int> env_cpu(char const *name) {
+  char const *value = std::getenv(name);
+  if (!value || !*value)
+    return std::nullopt;
+  try {
+    return std::stoul(value);
+  } catch (std::logic_error const &) {
+    throw std::invalid_argument{std::string{"invalid CPU in "} + name};
+  }
+}
+
+/*
+ * Pins the calling thread to the client CPU and restores its affinity on
+ * destruction.
+ */
+class Placement {
+public:
+  Placement() {
+    if (sched_getaffinity(0, sizeof(saved), &saved))
+      throw std::system_error{errno, std::generic_category(),
+                              "cannot get CPU affinity"};
+    auto allowed = os::allowed_cpus();
+
+    auto cpu = env_cpu("RPC_CLIENT_CPU");
+    if (cpu) {
+      client = *cpu;
+    } else {
+      int current = sched_getcpu();
+      if (current < 0)
+        throw std::system_error{errno, std::generic_category(),
+                                "cannot get current CPU"};
+      client = current;
+    }
+
+    if (auto cpu = env_cpu("RPC_SERVER_CPU")) {
+      server = *cpu;
+    } else {
+      auto other =
+          std::find_if(allowed.begin(), allowed.end(),
+                       [&](unsigned int other) { return other != client; });
+      if (other == allowed.end())
+        throw std::runtime_error{"no CPU for the RPC server"};
+      server = *other;
+    }
+
+    if (client == server)
+      throw std::invalid_argument{"RPC client and server share a CPU"};
+    if (!os::pin_cpu(client))
+      throw std::system_error{errno, std::generic_category(),
+                              "cannot pin RPC client"};
+  }
+  ~Placement() { sched_setaffinity(0, sizeof(saved), &saved); }
+  Placement(Placement const &) = delete;
+  Placement &operator=(Placement const &) = delete;
+
+  unsigned int get_client() const { return client; }
+  unsigned int get_server() const { return server; }
+
+private:
+  cpu_set_t saved;
+  unsigned int client, server;
+};
+
+/*
+ * Server thread polling for requests until destruction.
+ *
+ * Construction fails if the thread cannot be pinned to its CPU, as it might
+ * then spin on the CPU of the client.
+ */
+class Server {
+public:
+  explicit Server(unsigned int cpu)
+      : shared(new char[fce::DATA_SIZE]()),
+        array(new char[fce::ARRAY_SIZE * fce::DATA_SIZE]()) {
+    std::promise<int> pinned;
+    auto result = pinned.get_future();
+    thread = std::thread{&Server::serve, this, cpu, std::move(pinned)};
+    if (int err = result.get()) {
+      thread.join();
+      throw std::system_error{err, std::generic_category(),
+                              "cannot pin RPC server to CPU " +
+                                  std::to_string(cpu)};
+    }
+  }
+  ~Server() {
+    submit({STOP, 0, 0, 0});
+    thread.join();
+  }
+  Server(Server const &) = delete;
+  Server &operator=(Server const &) = delete;
+
+  /* Buffer the array operation copies from */
+  char *get_shared() const { return shared.get(); }
+
+  void submit(Message const &request) {
+    while (!requests.push(request))
+      relax();
+  }
+
+  long complete() {
+    Message response;
+    while (!responses.pop(response))
+      relax();
+    return response.result;
+  }
+
+  long call(Op op, unsigned long arg0 = 0, unsigned long arg1 = 0) {
+    submit({op, arg0, arg1, 0});
+    return complete();
+  }
+
+private:
+  Ring requests, responses;
+  std::unique_ptr<char[]> shared, array;
+  std::thread thread;
+
+  /* Reports the errno of pinning or 0 through pinned. */
+  void serve(unsigned int cpu, std::promise<int> pinned) {
+    if (!os::pin_cpu(cpu)) {
+      pinned.set_value(errno);
+      return;
+    }
+    pinned.set_value(0);
+
+    Message message;
+    while (true) {
+      while (!requests.pop(message))
+        relax();
+      if (message.op == STOP)
+        return;
+
+      message.result = execute(message);
+      while (!responses.push(message))
+        relax();
+    }
+  }
+
+  long execute(Message const &request) {
+    switch (request.op) {
+    case NOOP:
+      return 0;
+    case STACK:
+      return request.arg0;
+    case PRIV:
+      return request.arg0 + 1;
+    case ARRAY:
+      if (request.arg0 >= fce::ARRAY_SIZE || request.arg1 > fce::DATA_SIZE)
+        return -EINVAL;
+      std::memcpy(array.get() + request.arg0 * fce::DATA_SIZE, shared.get(),
+                  request.arg1);
+      return 0;
+    default:
+      return -EINVAL;
+    }
+  }
+};
+
+/*
+ * Fixture with an RPC server, the placement is reported as counters.
+ */
+class RPCFixture : public benchmark::Fixture {
+public:
+  void SetUp(::benchmark::State &state) override {
+    try {
+      placement.reset(new Placement{});
+      server.reset(new Server{placement->get_server()});
+    } catch (std::exception const &e) {
+      state.SkipWithError(e.what());
+      return;
+    }
+
+    state.counters["client_cpu"] = placement->get_client();
+    state.counters["server_cpu"] = placement->get_server();
+  }
+
+  void TearDown(::benchmark::State &) override {
+    server.reset();
+    placement.reset();
+  }
+
+protected:
+  std::unique_ptr<Placement> placement;
+  std::unique_ptr<Server> server;
+};
+
+} // namespace rpc
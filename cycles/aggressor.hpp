@@ -0,0 +1,243 @@
+/*
+ * Co-located noise generators to measure the mechanisms on a busy machine.
+ *
+ * Every aggressor is a thread pinned to another CPU which runs for as long
+ * as the aggressor object lives. The tail percentiles measured under each
+ * aggressor are compared to those of a quiet run.
+ */
+
+#pragma once
+
+#include "fccmp.hpp"
+#include "os.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace aggressor {
+
+enum class Kind {
+  /* Streaming copies between two buffers larger than the LLC */
+  MEMBW,
+  /* Line-granular updates all over a buffer of the LLC size */
+  LLC,
+  /* Empty system calls or fccmp ioctls on the SMT sibling */
+  SYSCALL,
+  /* Mapping and unmapping a page, which shoots down the TLB of all CPUs
+     running the process */
+  TLB,
+};
+
+static const std::array<char const *, 4> NAMES{"membw", "llc", "syscall",
+                                               "tlb"};
+
+/* Stride of the LLC thrasher in lines, prime to visit every line */
+static const std::size_t LLC_STRIDE = 4099;
+
+static inline char const *name(Kind kind) {
+  return NAMES[static_cast<std::size_t>(kind)];
+}
+
+/*
+ * Parse a comma-separated list of aggressor names.
+ */
+static inline std::vector<Kind> parse(std::string const &list) {
+  std::vector<Kind> kinds;
+  std::stringstream stream{list};
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    auto it = std::find(NAMES.begin(), NAMES.end(), item);
+    if (it == NAMES.end())
+      throw std::invalid_argument{"unknown aggressor " + item +
+                                  " (membw, llc, syscall or tlb)"};
+    kinds.push_back(static_cast<Kind>(it - NAMES.begin()));
+  }
+  return kinds;
+}
+
+/*
+ * Return the CPU an aggressor of kind runs on while cpu is measured.
+ *
+ * The syscall storm shares the core of cpu. All other aggressors run on
+ * another core, so they only compete for the shared caches, memory and
+ * TLB-shootdown interrupts. cpus are the CPUs the process may use.
+ */
+static inline std::optional<unsigned int>
+choose_cpu(Kind kind, unsigned int cpu, std::vector<unsigned int> const &cpus) {
+  auto siblings = os::smt_siblings(cpu);
+  if (kind == Kind::SYSCALL)
+    return siblings.empty() ? std::nullopt
+                            : std::make_optional(siblings.front());
+
+  for (unsigned int other : cpus)
+    if (other != cpu &&
+        std::find(siblings.begin(), siblings.end(), other) == siblings.end())
+      return other;
+  return std::nullopt;
+}
+
+/*
+ * Thread generating the noise of one kind until destruction.
+ */
+class Aggressor {
+public:
+  Aggressor(Kind kind, unsigned int cpu) : kind{kind} {
+    if (kind == Kind::MEMBW)
+      size = 4 * os::llc_size();
+    else if (kind == Kind::LLC)
+      size = os::llc_size();
+    if (size)
+      buffer.reset(new char[size]());
+
+    thread = std::thread{&Aggressor::run, this, cpu};
+    while (!ready.load(std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+  ~Aggressor() {
+    stop.store(true, std::memory_order_relaxed);
+    thread.join();
+  }
+  Aggressor(Aggressor const &) = delete;
+  Aggressor &operator=(Aggressor const &) = delete;
+
+private:
+  Kind kind;
+  std::size_t size = 0;
+  std::unique_ptr<char[]> buffer;
+  std::atomic<bool> ready{false}, stop{false};
+  std::thread thread;
+
+  void run(unsigned int cpu) {
+    if (!os::pin_cpu(cpu))
+      std::cerr << "cannot pin aggressor to CPU " << cpu << ": "
+                << std::strerror(errno) << '\n';
+    ready.store(true, std::memory_order_release);
+
+    switch (kind) {
+    case Kind::MEMBW:
+      return membw();
+    case Kind::LLC:
+      return llc();
+    case Kind::SYSCALL:
+      return storm();
+    case Kind::TLB:
+      return shootdown();
+    }
+  }
+
+  void membw() {
+    std::size_t half = size / 2;
+    while (!stop.load(std::memory_order_relaxed)) {
+      std::memcpy(buffer.get() + half, buffer.get(), half);
+      std::memcpy(buffer.get(), buffer.get() + half, half);
+    }
+  }
+
+  void llc() {
+    // The large stride defeats the prefetchers.
+    std::size_t lines = size / os::CACHE_LINE_SIZE, line = 0;
+    while (!stop.load(std::memory_order_relaxed)) {
+      for (std::size_t i = 0; i < lines; i++) {
+        buffer[line * os::CACHE_LINE_SIZE]++;
+        line = (line + LLC_STRIDE) % lines;
+      }
+    }
+  }
+
+  void storm() {
+    // The real device, emulated ioctls would not enter the kernel
+    int fd = open(fccmp::DEVICE_FILE, O_RDWR);
+    while (!stop.load(std::memory_order_relaxed)) {
+      if (fd >= 0)
+        ioctl(fd, fccmp::IOCTL_NOOP);
+      else
+        syscall(SYS_getppid);
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+
+  void shootdown() {
+    std::size_t len = getpagesize();
+    while (!stop.load(std::memory_order_relaxed)) {
+      void *page = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (page == MAP_FAILED)
+        continue;
+      *static_cast<volatile char *>(page) = 1;
+      munmap(page, len);
+    }
+  }
+};
+
+/* Percentiles compared between the quiet and the noisy runs */
+static const std::array<std::pair<char const *, double>, 3> PERCENTILES{{
+    {"median", 50},
+    {"p99", 99},
+    {"p99.9", 99.9},
+}};
+
+/*
+ * Print the percentiles of a benchmark under every aggressor and their
+ * inflation relative to the quiet run as CSV rows.
+ *
+ * runs holds the name of the aggressor and the samples of every run with the
+ * quiet run first.
+ */
+static void
+print(std::ostream &out, std::string const &benchmark,
+      std::vector<std::pair<std::string, std::vector<std::uint64_t>>> &runs) {
+  std::vector<std::uint64_t> quiet;
+  for (auto const &percentile : PERCENTILES)
+    quiet.push_back(stats::percentile(runs[0].second, percentile.second));
+
+  for (auto &[aggressor, samples] : runs) {
+    out << benchmark << ',' << aggressor;
+    std::vector<double> inflation;
+    for (std::size_t i = 0; i < PERCENTILES.size(); i++) {
+      auto value = stats::percentile(samples, PERCENTILES[i].second);
+      out << ',' << value;
+      inflation.push_back(quiet[i] ? static_cast<double>(value) / quiet[i]
+                                   : 0);
+    }
+    for (double ratio : inflation)
+      out << ',' << ratio;
+    out << '\n';
+  }
+  out.flush();
+}
+
+/*
+ * Print the header of the comparison table.
+ */
+static inline void print_header(std::ostream &out, std::string const &unit) {
+  out << "# " << unit << " under co-located aggressors, inflation relative "
+      << "to the quiet run\n";
+  out << "benchmark,aggressor";
+  for (auto const &percentile : PERCENTILES)
+    out << ',' << percentile.first;
+  for (auto const &percentile : PERCENTILES)
+    out << ',' << percentile.first << "_inflation";
+  out << '\n';
+}
+
+} // namespace aggressor
@@ -0,0 +1,268 @@
+/*
+ * arm64-specific implementation for low-overhead, user-space reads of the
+ * performance counters from EL0.
+ *
+ * The counters are read with MRS as advertised by cap_user_rdpmc in the perf
+ * pages, the elapsed time from the virtual counter CNTVCT_EL0. This requires
+ * a kernel with user-space counter access (Linux 5.17+) and
+ * kernel.perf_user_access set to 1. Otherwise, the generic implementation is
+ * used as fallback.
+ */
+
+#pragma once
+
+#include "compiler.hpp"
+#include "generic.hpp"
+#include "perf.hpp"
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace cycles {
+
+/* Request a 64-bit counter, config1 bit 0 */
+static const std::uint64_t LONG_COUNTER = 0x1;
+/* Request user-space access, config1 bit 1 */
+static const std::uint64_t USER_ACCESS = 0x2;
+
+/* Counter number of PMCCNTR_EL0, perf reports it as index 32 */
+static const std::uint32_t CYCLE_COUNTER = 31;
+
+/*
+ * Request user-space access for every event.
+ *
+ * Only the cycle counter is 64 bits wide on all PMUs. Most PMUs reject long
+ * event counters with user-space access, so the other events keep their
+ * native width.
+ */
+static inline std::uint64_t user_config1(perf::Event const &event) {
+  bool cycles = event.type == PERF_TYPE_HARDWARE &&
+                event.config == PERF_COUNT_HW_CPU_CYCLES;
+  return USER_ACCESS | (cycles ? LONG_COUNTER : 0);
+}
+
+/*
+ * Open the counters with user-space access, or without it for the generic
+ * fallback if the kernel does not support it.
+ */
+static inline std::vector<int>
+arch_open_counters(std::vector<perf::Event> const &events) {
+  try {
+    return perf::initialize(events, user_config1);
+  } catch (std::system_error const &e) {
+    std::cerr << e.what() << " with user-space access, retrying without"
+              << std::endl;
+    return perf::initialize(events);
+  }
+}
+
+using generic::counts_t;
+using generic::elapsed_t;
+
+/* Unit of the clock ticks */
+static const char CLOCK_UNIT[] = "timer tick";
+
+/*
+ * Perf pages of all counted events, or the generic context if they cannot be
+ * read from user space.
+ */
+struct perf_context {
+  std::size_t events;
+  std::array<perf_event_mmap_page const *, perf::MAX_EVENTS> pages;
+  std::optional<generic::perf_context> fallback;
+};
+
+/*
+ * Return whether the counter of a perf page can be read from user space.
+ */
+static inline bool user_readable(perf_event_mmap_page const *page) {
+  std::uint32_t seq;
+  bool readable;
+  do {
+    seq = compiler::read_once(page->lock);
+    compiler::barrier();
+    readable = page->cap_user_rdpmc && page->index;
+    compiler::barrier();
+  } while (seq != compiler::read_once(page->lock));
+  return readable;
+}
+
+/*
+ * Map the perf pages of all events to user space and fall back to the
+ * generic implementation if any of them is not readable.
+ */
+static inline perf_context arch_init_counter(std::vector<int> const &fds) {
+  perf_context pc{fds.size(), {}, std::nullopt};
+  bool readable = true;
+  for (std::size_t i = 0; i < fds.size(); i++) {
+    pc.pages[i] = perf::mmap(fds[i]);
+    readable &= user_readable(pc.pages[i]);
+  }
+
+  if (!readable) {
+    std::cerr << "cannot read counters from user space (see "
+                 "kernel.perf_user_access), falling back to system calls"
+              << std::endl;
+    pc.fallback = generic::arch_init_counter(fds);
+  }
+  return pc;
+}
+
+/*
+ * Return the width of the hardware counters in bits.
+ */
+static inline std::uint8_t arch_counter_width(perf_context const &pc) {
+  return pc.fallback ? generic::arch_counter_width(*pc.fallback)
+                     : pc.pages[0]->pmc_width;
+}
+
+/*
+ * Return the conversion of timer ticks to nanoseconds.
+ *
+ * The kernel publishes it if the timer is its sched_clock, otherwise the
+ * frequency in CNTFRQ_EL0 is used.
+ */
+static inline std::optional<perf::TimeConversion>
+arch_clock(perf_context const &pc) {
+  if (!pc.fallback)
+    if (auto conversion = perf::time_conversion(pc.pages[0]))
+      return conversion;
+
+  std::uint64_t frequency;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+  if (!frequency)
+    return std::nullopt;
+
+  // Largest shift for which the multiplier fits into 32 bits
+  std::uint16_t shift = 32;
+  while (shift && (1000000000ull << shift) / frequency > UINT32_MAX)
+    shift--;
+  return perf::TimeConversion{
+      static_cast<std::uint32_t>((1000000000ull << shift) / frequency), shift,
+      0};
+}
+
+static INLINE void isb() { asm volatile("isb" : : : "memory"); }
+
+static INLINE std::uint64_t read_timer() {
+  std::uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks) : : "memory");
+  return ticks;
+}
+
+/*
+ * Return the mask of the valid bits of a counter.
+ */
+static INLINE std::uint64_t counter_mask(perf_event_mmap_page const *page) {
+  return page->pmc_width >= 64 ? ~std::uint64_t{0}
+                               : (std::uint64_t{1} << page->pmc_width) - 1;
+}
+
+/*
+ * Read the counter with the given number.
+ *
+ * Event counters are selected with PMSELR_EL0, which EL0 may write if event
+ * counter reads are enabled.
+ */
+static INLINE std::uint64_t read_counter(std::uint32_t counter) {
+  std::uint64_t value;
+  if (counter == CYCLE_COUNTER) {
+    asm volatile("mrs %0, pmccntr_el0" : "=r"(value) : : "memory");
+  } else {
+    asm volatile("msr pmselr_el0, %1\n\t"
+                 "isb\n\t"
+                 "mrs %0, pmxevcntr_el0"
+                 : "=r"(value)
+                 : "r"(static_cast<std::uint64_t>(counter))
+                 : "memory");
+  }
+  return value;
+}
+
+/*
+ * Read the current values of all counters.
+ *
+ * All counters are read in one section protected by the sequence locks of
+ * all perf pages. If this gets interrupted by some modification, no counts
+ * are returned.
+ */
+static INLINE bool perf_counts(perf_context const &pc, counts_t &counts) {
+  std::array<std::uint32_t, perf::MAX_EVENTS> seq;
+
+  isb();
+
+  // The loads of the sequence locks must complete before the counter reads.
+  for (std::size_t i = 0; i < pc.events; i++)
+    seq[i] = __atomic_load_n(&pc.pages[i]->lock, __ATOMIC_ACQUIRE);
+
+  for (std::size_t i = 0; i < pc.events; i++) {
+    auto page = pc.pages[i];
+    std::uint32_t idx = page->index;
+    if (!page->cap_user_rdpmc || !idx)
+      throw std::runtime_error("cannot read performance counter");
+
+    counts[i] = read_counter(idx - 1) & counter_mask(page);
+  }
+
+  isb();
+  for (std::size_t i = 0; i < pc.events; i++)
+    if (seq[i] != __atomic_load_n(&pc.pages[i]->lock, __ATOMIC_ACQUIRE))
+      return false;
+
+  return true;
+}
+
+typedef elapsed_t cycles_t;
+
+/*
+ * Read the performance counters until a valid result is obtained.
+ *
+ * The fallback resets the counters instead, but the timer is read in both
+ * cases so that the clock ticks have the same unit. It is read outside of
+ * the counted section.
+ */
+static INLINE cycles_t arch_start(perf_context const &pc) {
+  cycles_t start;
+  if (pc.fallback) {
+    start.ticks = read_timer();
+    generic::arch_start(*pc.fallback);
+    return start;
+  }
+
+  do
+    start.ticks = read_timer();
+  while (!perf_counts(pc, start.counts));
+  return start;
+}
+
+/*
+ * Calculate the elapsed counts of all events and the elapsed timer ticks.
+ */
+static INLINE std::optional<elapsed_t> arch_end(perf_context const &pc,
+                                                cycles_t const &start) {
+  if (pc.fallback) {
+    elapsed_t end;
+    generic::disable(*pc.fallback);
+    end.ticks = read_timer() - start.ticks;
+    generic::read_counts(*pc.fallback, end.counts);
+    return end;
+  }
+
+  elapsed_t end;
+  if (!perf_counts(pc, end.counts))
+    return std::nullopt;
+  end.ticks = read_timer() - start.ticks;
+
+  // Counters narrower than 64 bits wrap around at their width.
+  for (std::size_t i = 0; i < pc.events; i++)
+    end.counts[i] =
+        (end.counts[i] - start.counts[i]) & counter_mask(pc.pages[i]);
+  return end;
+}
+
+} // namespace cycles
@@ -0,0 +1,91 @@
+/*
+ * Detection of core frequency changes during a run.
+ *
+ * The core cycles per clock tick of consecutive windows of samples are
+ * compared. They stay constant at a fixed core frequency but change with
+ * turbo transitions, frequency scaling or thermal throttling.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <ostream>
+
+namespace frequency {
+
+/* Number of samples per window */
+static const std::uint64_t WINDOW = 1000;
+/* Tolerated relative difference between the slowest and fastest window */
+static const double TOLERANCE = 0.02;
+
+class Drift {
+public:
+  /*
+   * event is the index of the cycles event, if it is counted at all.
+   */
+  Drift(std::optional<std::size_t> event, char const *unit)
+      : event{event}, unit{unit} {}
+
+  std::optional<std::size_t> get_event() const { return event; }
+
+  /*
+   * Add the cycles and clock ticks of one sample.
+   */
+  void add(std::uint64_t cycles, std::uint64_t ticks) {
+    window_cycles += cycles;
+    window_ticks += ticks;
+    if (++samples == WINDOW)
+      close_window();
+  }
+
+  /*
+   * Print the range of cycles per tick as comment lines, flag a drift and
+   * reset.
+   *
+   * A partial last window is only used if there is no full one.
+   */
+  void report(std::ostream &out) {
+    if (!event)
+      return;
+    if (!windows && samples)
+      close_window();
+    if (!windows)
+      return;
+
+    out << "# cycles per " << unit << ": min " << std::fixed
+        << std::setprecision(4) << min << " max " << max
+        << std::defaultfloat << '\n';
+    if (windows > 1 && max > min * (1 + TOLERANCE)) {
+      out << "# frequency drift: cycles per " << unit << " changed by "
+          << (max / min - 1) * 100 << "%\n";
+      std::cerr << "frequency drift detected, results are unreliable"
+                << std::endl;
+    }
+    out.flush();
+
+    windows = samples = window_cycles = window_ticks = 0;
+  }
+
+private:
+  std::optional<std::size_t> event;
+  char const *unit;
+  std::uint64_t samples = 0, windows = 0;
+  std::uint64_t window_cycles = 0, window_ticks = 0;
+  double min = 0, max = 0;
+
+  void close_window() {
+    if (window_ticks) {
+      double ratio = static_cast<double>(window_cycles) / window_ticks;
+      min = windows ? std::min(min, ratio) : ratio;
+      max = windows ? std::max(max, ratio) : ratio;
+      windows++;
+    }
+    samples = window_cycles = window_ticks = 0;
+  }
+};
+
+} // namespace frequency
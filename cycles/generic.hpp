@@ -1,8 +1,18 @@
 /*
- * Generic implementation for reading the performance counter using ioctls
- * and reads to the perf file descriptor.
+ * Generic implementation for reading the performance counters using ioctls
+ * and reads to the perf file descriptor of the group leader.
+ *
+ * The elapsed time is taken from CLOCK_MONOTONIC_RAW in nanoseconds.
+ *
+ * This costs several system calls per sample and is only used on
+ * architectures without a user-space backend or as fallback if the kernel
+ * denies user-space counter reads.
  */
 
+#pragma once
+
+#include "perf.hpp"
+#include <array>
 #include <cstdint>
 #include <errno.h>
 #include <linux/perf_event.h>
@@ -10,53 +20,128 @@
 #include <stdexcept>
 #include <sys/ioctl.h>
 #include <system_error>
+#include <time.h>
 #include <unistd.h>
+#include <vector>
 
 #define INLINE inline __attribute__((always_inline))
 
-namespace cycles {
+namespace cycles::generic {
+
+/*
+ * Open the counters, no user-space access needs to be requested.
+ */
+static inline std::vector<int>
+arch_open_counters(std::vector<perf::Event> const &events) {
+  return perf::initialize(events);
+}
+
+typedef std::array<std::uint64_t, perf::MAX_EVENTS> counts_t;
+
+/* Unit of the clock ticks */
+static const char CLOCK_UNIT[] = "ns";
+
+/*
+ * Elapsed counts of all events and elapsed clock ticks.
+ */
+struct elapsed_t {
+  counts_t counts;
+  std::uint64_t ticks;
+};
 
-typedef int perf_context;
+/*
+ * File descriptor of the group leader and number of events in the group.
+ */
+struct perf_context {
+  int fd;
+  std::size_t events;
+};
 
 /*
- * Reflect the file descriptor.
+ * Reflect the file descriptor of the group leader.
  */
-perf_context arch_init_counter(int fd) {
-  if (ioctl(fd, PERF_EVENT_IOC_DISABLE, 0))
+static inline perf_context arch_init_counter(std::vector<int> const &fds) {
+  if (ioctl(fds.front(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP))
     throw std::system_error{errno, std::generic_category()};
-  return fd;
+  return {fds.front(), fds.size()};
 }
 
-/* Unused in this implementation. */
-typedef char cycles_t;
+/*
+ * The kernel extends the counter to 64 bits.
+ */
+static inline std::uint8_t arch_counter_width(perf_context const &) {
+  return 64;
+}
 
 /*
- * Reset and start the cycle counter via ioctl.
+ * The clock ticks are nanoseconds already.
  */
-static INLINE cycles_t arch_start(perf_context pc) {
-  if (ioctl(pc, PERF_EVENT_IOC_RESET, 0) || ioctl(pc, PERF_EVENT_IOC_ENABLE, 0))
-    throw std::system_error{errno, std::generic_category()};
+static inline std::optional<perf::TimeConversion>
+arch_clock(perf_context const &) {
+  return perf::TimeConversion{1, 0, 0};
+}
 
-  return 0;
+static INLINE std::uint64_t clock_ns() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 
+/* Start time, the counters are reset instead. */
+typedef std::uint64_t cycles_t;
+
 /*
- * Calculate the elapsed cycles.
+ * Reset and start the counters via ioctl.
+ *
+ * The clock is read before the counters are enabled here and after they are
+ * disabled in arch_end, so clock_gettime is not counted.
  */
-static INLINE std::optional<std::uint64_t>
-arch_end(perf_context pc, __attribute__((unused)) cycles_t start) {
-  std::uint64_t elapsed;
+static INLINE cycles_t arch_start(perf_context const &pc) {
+  std::uint64_t start = clock_ns();
+  if (ioctl(pc.fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) ||
+      ioctl(pc.fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP))
+    throw std::system_error{errno, std::generic_category()};
+
+  return start;
+}
 
-  if (ioctl(pc, PERF_EVENT_IOC_DISABLE, 0))
+/*
+ * Stop the counters via ioctl.
+ */
+static INLINE void disable(perf_context const &pc) {
+  if (ioctl(pc.fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP))
     throw std::system_error{errno, std::generic_category()};
+}
 
-  auto ret = read(pc, &elapsed, sizeof(elapsed));
+/*
+ * Read the counts of the stopped counters.
+ */
+static INLINE void read_counts(perf_context const &pc, counts_t &counts) {
+  // Layout for PERF_FORMAT_GROUP: number of events followed by the values
+  std::array<std::uint64_t, perf::MAX_EVENTS + 1> buf;
+
+  std::size_t size = (pc.events + 1) * sizeof(std::uint64_t);
+  auto ret = read(pc.fd, buf.data(), size);
   if (ret < 0)
     throw std::system_error{errno, std::generic_category()};
-  else if (ret != sizeof(elapsed))
+  else if (static_cast<std::size_t>(ret) != size || buf[0] != pc.events)
     throw std::runtime_error{"counter read returned with wrong size"};
 
+  std::copy(buf.begin() + 1, buf.begin() + 1 + pc.events, counts.begin());
+}
+
+/*
+ * Read the elapsed counts of all events and the elapsed nanoseconds.
+ */
+static INLINE std::optional<elapsed_t> arch_end(perf_context const &pc,
+                                                cycles_t start) {
+  disable(pc);
+  std::uint64_t end = clock_ns();
+
+  elapsed_t elapsed;
+  read_counts(pc, elapsed.counts);
+  elapsed.ticks = end - start;
   return std::make_optional(elapsed);
 }
 
-} // namespace cycles
+} // namespace cycles::generic
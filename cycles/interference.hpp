@@ -0,0 +1,172 @@
+/*
+ * Detection of samples disturbed by context switches, page faults, CPU
+ * migrations or hardware interrupts.
+ */
+
+#pragma once
+
+#include "perf.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace interference {
+
+enum class Mode {
+  /* Do not monitor */
+  OFF,
+  /* Keep disturbed samples and mark them in an extra column */
+  TAG,
+  /* Drop disturbed samples and repeat the iteration */
+  REJECT,
+};
+
+static inline Mode parse_mode(std::string const &name) {
+  if (name == "off")
+    return Mode::OFF;
+  else if (name == "tag")
+    return Mode::TAG;
+  else if (name == "reject")
+    return Mode::REJECT;
+  throw std::invalid_argument{"unknown interference mode " + name +
+                              " (off, tag or reject)"};
+}
+
+/*
+ * Reasons for discarding a sample, the bit index in a tag equals the index.
+ *
+ * The software events come first in the order of perf::SOFTWARE_EVENTS.
+ */
+static const std::size_t INTERRUPTS = perf::SOFTWARE_EVENTS.size();
+static const std::size_t COUNTER_READ = INTERRUPTS + 1;
+static const std::array<char const *, COUNTER_READ + 1> REASONS{
+    perf::SOFTWARE_EVENTS[0].name, perf::SOFTWARE_EVENTS[1].name,
+    perf::SOFTWARE_EVENTS[2].name, "interrupts", "counter-read"};
+
+/* Tolerated number of rejections per requested sample */
+static const std::uint64_t MAX_REJECTIONS = 100;
+
+/*
+ * Reads the interference counters before and after every sample.
+ *
+ * The software events are read as one group with a single read() and the
+ * optional raw interrupt event with a second one, both outside the measured
+ * section. The system calls still run right before the measured call and
+ * leave their footprint in the caches, TLBs and branch predictors.
+ */
+class Monitor {
+public:
+  Monitor(Mode mode, std::optional<std::uint64_t> irq_config) : mode{mode} {
+    if (mode == Mode::OFF)
+      return;
+
+    software_fd = perf::open_group(std::vector<perf::Event>{
+        perf::SOFTWARE_EVENTS.begin(), perf::SOFTWARE_EVENTS.end()});
+    if (irq_config)
+      irq_fd = perf::open_event(perf::raw_event("interrupts", *irq_config), -1);
+  }
+  ~Monitor() {
+    if (software_fd >= 0)
+      close(software_fd);
+    if (irq_fd >= 0)
+      close(irq_fd);
+  }
+  Monitor(Monitor const &) = delete;
+  Monitor &operator=(Monitor const &) = delete;
+
+  Mode get_mode() const { return mode; }
+
+  /*
+   * Read the counters before a sample.
+   */
+  void begin() {
+    if (mode != Mode::OFF)
+      read_counts(before);
+  }
+
+  /*
+   * Read the counters after a sample and return the reasons as bit mask.
+   */
+  unsigned end() {
+    if (mode == Mode::OFF)
+      return 0;
+
+    std::array<std::uint64_t, INTERRUPTS + 1> after{};
+    read_counts(after);
+
+    unsigned tag = 0;
+    for (std::size_t i = 0; i <= INTERRUPTS; i++)
+      if (after[i] != before[i])
+        tag |= 1 << i;
+    return tag;
+  }
+
+  /*
+   * Count a rejected sample for all reasons in tag.
+   */
+  void reject(unsigned tag) {
+    add(rejected, tag);
+    total++;
+  }
+
+  /*
+   * Count a kept but tagged sample for all reasons in tag.
+   */
+  void keep(unsigned tag) { add(tagged, tag); }
+
+  std::uint64_t get_rejected() const { return total; }
+
+  /*
+   * Print the tagged and rejected counts per reason as comment lines and
+   * reset them.
+   */
+  void report(std::ostream &out) {
+    if (mode == Mode::OFF)
+      return;
+
+    if (mode == Mode::TAG)
+      print(out, "tagged", tagged);
+    print(out, "rejected", rejected);
+    out.flush();
+
+    tagged.fill(0);
+    rejected.fill(0);
+    total = 0;
+  }
+
+private:
+  Mode mode;
+  int software_fd = -1, irq_fd = -1;
+  std::array<std::uint64_t, INTERRUPTS + 1> before{};
+  std::array<std::uint64_t, REASONS.size()> tagged{}, rejected{};
+  std::uint64_t total = 0;
+
+  static void add(std::array<std::uint64_t, REASONS.size()> &counts,
+                  unsigned tag) {
+    for (std::size_t i = 0; i < REASONS.size(); i++)
+      if (tag & (1 << i))
+        counts[i]++;
+  }
+
+  void print(std::ostream &out, char const *what,
+             std::array<std::uint64_t, REASONS.size()> const &counts) const {
+    for (std::size_t i = 0; i < REASONS.size(); i++) {
+      if (i == INTERRUPTS && irq_fd < 0)
+        continue;
+      out << "# " << what << ' ' << REASONS[i] << ": " << counts[i] << '\n';
+    }
+  }
+
+  void read_counts(std::array<std::uint64_t, INTERRUPTS + 1> &counts) {
+    perf::read_group(software_fd, counts.data(), INTERRUPTS);
+    if (irq_fd >= 0)
+      perf::read_group(irq_fd, &counts[INTERRUPTS], 1);
+  }
+};
+
+} // namespace interference
@@ -1,7 +1,18 @@
+#include "aggressor.hpp"
+#include "compiler.hpp"
+#include "env.hpp"
 #include "fastcall.hpp"
 #include "fccmp.hpp"
+#include "frequency.hpp"
+#include "interference.hpp"
 #include "options.hpp"
 #include "perf.hpp"
+#include "registry.hpp"
+#include "report.hpp"
+#include "samples.hpp"
+#include "scaling.hpp"
+#include "vdso.hpp"
+#include <algorithm>
 #include <cstring>
 #include <elf.h>
 #include <fcntl.h>
@@ -14,11 +25,17 @@
 #include <sys/syscall.h>
 #include <system_error>
 #include <unistd.h>
+#include <vector>
 
 #if defined(__i386__) || defined(__x86_64__)
 #include "x86.hpp"
+#elif defined(__aarch64__)
+#include "arm64.hpp"
 #else
 #include "generic.hpp"
+namespace cycles {
+using namespace generic;
+}
 #endif
 
 #define INLINE inline __attribute__((always_inline))
@@ -27,16 +44,16 @@ namespace cycles {
 
 static const int NICENESS = -20;
 
-/* Initialize a perf memory map for reading the performance counter. */
-static perf_context initialize_pc() {
+/* Initialize perf memory maps for reading the performance counters. */
+static perf_context initialize_pc(std::vector<perf::Event> const &events) {
   errno = 0;
   if (nice(NICENESS) < 0 && errno)
     std::cerr << "cannot set niceness of this thread, continuing anyway: "
               << std::strerror(errno) << std::endl;
 
-  int fd = perf::initialize();
+  auto fds = arch_open_counters(events);
 
-  perf_context pc = arch_init_counter(fd);
+  perf_context pc = arch_init_counter(fds);
 
   // Lock all pages to avoid faults during benchmarks
   if (mlockall(MCL_CURRENT | MCL_FUTURE))
@@ -50,24 +67,44 @@ static perf_context initialize_pc() {
 
 namespace crtl {
 
+/*
+ * Fixed-point scale of the amortized counts per call, which are stored as
+ * integers like all samples. The scale is part of the column names.
+ */
+static const std::uint64_t PER_CALL_SCALE = 1000;
+
 /*
  * Controller which counts the performed iterations and prints the measured
- * cycles.
+ * counts of all events.
+ *
+ * If the clock ticks can be converted, the elapsed nanoseconds follow the
+ * counts of the events and the cycles per tick are checked for drift.
+ *
+ * With a batch size above one, every sample additionally times batch
+ * back-to-back invocations and reports the amortized counts per call,
+ * multiplied by PER_CALL_SCALE, after the counts of the single invocation.
+ *
+ * Samples disturbed by interference are tagged in the last column or
+ * rejected, depending on the mode of the monitor.
+ *
+ * The samples are passed to an output which might defer writing them until
+ * finish() is called.
  */
 class Controller {
   cycles::perf_context pc;
-  std::uint64_t iters, bench_iters;
+  std::optional<perf::TimeConversion> clock;
+  std::uint64_t iters, bench_iters, batch;
   cycles::cycles_t start;
-
-public:
-  Controller(cycles::perf_context pc, std::uint64_t warmup_iters,
-             std::uint64_t bench_iters)
-      : pc{pc}, iters{warmup_iters + bench_iters}, bench_iters{bench_iters} {}
+  samples::Output &output;
+  interference::Monitor &monitor;
+  frequency::Drift &drift;
 
   /*
-   * Returns true as long as the benchmarks should continue.
+   * Amortize a value over the batch in fixed point, rounded to nearest.
    */
-  bool cont() { return iters > 0; }
+  std::uint64_t per_call(std::uint64_t value) const {
+    return (value * PER_CALL_SCALE + batch / 2) / batch;
+  }
 
   /*
    * Start a measured benchmark section.
@@ -75,121 +112,417 @@ public:
   void INLINE measure_start() { start = cycles::arch_start(pc); }
 
   /*
-   * End a measured benchmark section.
+   * End a measured benchmark section and return the elapsed counts.
+   */
+  std::optional<cycles::elapsed_t> INLINE measure_end() {
+    return cycles::arch_end(pc, start);
+  }
+
+public:
+  Controller(cycles::perf_context pc,
+             std::optional<perf::TimeConversion> clock,
+             std::uint64_t warmup_iters, std::uint64_t bench_iters,
+             std::uint64_t batch, samples::Output &output,
+             interference::Monitor &monitor, frequency::Drift &drift)
+      : pc{pc}, clock{clock}, iters{warmup_iters + bench_iters},
+        bench_iters{bench_iters}, batch{batch}, output{output},
+        monitor{monitor}, drift{drift} {}
+
+  /*
+   * Measure call until all iterations are done.
    *
-   * Prints the result if not still in the warmup phase.
+   * Prints or records the results if not still in the warmup phase.
    * After the warmup phase, measurements with interrupted counter reads will
    * be discarded.
+   * The compiler barrier keeps calls without side effects in the loop.
    */
-  void INLINE print_end() {
-    if (iters > bench_iters) {
+  template <class F> void INLINE measure(F const &call) {
+    std::array<std::uint64_t, 2 * (perf::MAX_EVENTS + 1) + 1> row;
+    std::size_t width = pc.events + bool(clock);
+    std::size_t columns = batch > 1 ? 2 * width : width;
+
+    while (iters > 0) {
+      monitor.begin();
+      measure_start();
+      call();
+      compiler::barrier();
+      auto single = measure_end();
+
+      std::optional<cycles::elapsed_t> total;
+      if (batch > 1) {
+        measure_start();
+        for (std::uint64_t i = 0; i < batch; i++) {
+          call();
+          compiler::barrier();
+        }
+        total = measure_end();
+      }
+      unsigned tag = monitor.end();
+
+      if (iters > bench_iters) {
+        iters--;
+        continue;
+      }
+      if (!single || (batch > 1 && !total))
+        tag = 1 << interference::COUNTER_READ;
+      if (tag && (monitor.get_mode() == interference::Mode::REJECT ||
+                  tag & (1 << interference::COUNTER_READ))) {
+        monitor.reject(tag);
+        if (monitor.get_rejected() >
+            interference::MAX_REJECTIONS * (bench_iters + 1))
+          throw std::runtime_error{"too many disturbed samples"};
+        continue;
+      }
+      if (tag)
+        monitor.keep(tag);
+
+      std::copy(single->counts.begin(), single->counts.begin() + pc.events,
+                row.begin());
+      if (clock)
+        row[pc.events] = clock->elapsed(single->ticks);
+      if (batch > 1) {
+        for (std::size_t i = 0; i < pc.events; i++)
+          row[width + i] = per_call(total->counts[i]);
+        if (clock)
+          row[width + pc.events] = per_call(clock->elapsed(total->ticks));
+      }
+      row[columns] = tag;
+
+      auto const &timed = batch > 1 ? *total : *single;
+      if (auto event = drift.get_event())
+        drift.add(timed.counts[*event], timed.ticks);
+      output.add(row.data());
       iters--;
-      return;
     }
+  }
 
-    auto elapsed = cycles::arch_end(pc, start);
-    if (!elapsed)
-      return;
-
-    std::cout << *elapsed << std::endl;
-    iters--;
+  /*
+   * Write out the results after the benchmark finished.
+   */
+  void finish() {
+    output.finish();
+    monitor.report(std::cout);
+    drift.report(std::cout);
   }
 };
 
 } // namespace crtl
 
+/*
+ * Options passed to every benchmark.
+ */
+struct Params {
+  scaling::Config scaling;
+};
+
+using Registrar = registry::Registrar<crtl::Controller, Params>;
+using registry::Kind;
+
 /* Just benchmark the cycle counting overhead itself. */
 static void benchmark_noop(crtl::Controller &controller) {
-  while (controller.cont()) {
-    controller.measure_start();
-    controller.print_end();
-  }
+  controller.measure([] {});
 }
+static Registrar noop_registrar{"noop", Kind::SAMPLES, benchmark_noop};
 
 /* Benchmark an empty fastcall. */
 static void benchmark_fastcall(crtl::Controller &controller) {
-  int fd = open(fce::DEVICE_FILE, O_RDONLY);
+  int fd = fce::open_device();
   if (fd < 0)
     throw std::system_error{errno, std::generic_category()};
 
   fce::ioctl_args args;
-  if (ioctl(fd, fce::IOCTL_NOOP, &args))
+  if (fce::register_fastcall(fd, fce::IOCTL_NOOP, &args))
     throw std::system_error{errno, std::generic_category()};
 
   if (fce::fastcall_syscall(args.index))
     throw std::runtime_error{"noop fastcall failed"};
 
-  while (controller.cont()) {
-    controller.measure_start();
-    fce::fastcall_syscall(args.index);
-    controller.print_end();
-  }
+  controller.measure([&] { fce::fastcall_syscall(args.index); });
 }
+static Registrar fastcall_registrar{"fastcall", Kind::SAMPLES,
+                                    benchmark_fastcall};
 
 /* Benchmark the empty vDSO function of fccmp. */
 static void benchmark_vdso(crtl::Controller &controller) {
-  vdso_init_from_sysinfo_ehdr(getauxval(AT_SYSINFO_EHDR));
-
-  auto noop = reinterpret_cast<fccmp::VDSO_NOOP_TYPE *>(
-      vdso_sym(fccmp::VDSO_VERSION, fccmp::VDSO_NOOP));
+  auto noop = vdso::get<vdso::FCCMP_NOOP>();
   if (!noop)
     throw std::runtime_error{"noop vDSO function not found"};
 
   if (noop())
     throw std::runtime_error{"noop vDSO function failed"};
 
-  while (controller.cont()) {
-    controller.measure_start();
-    noop();
-    controller.print_end();
-  }
+  controller.measure(noop);
 }
+static Registrar vdso_registrar{"vdso", Kind::SAMPLES, benchmark_vdso};
 
 /* Benchmark an empty system call. */
 static void benchmark_syscall(crtl::Controller &controller) {
   if (syscall(fccmp::NR_SYS_NI_SYSCALL) >= 0 || errno != ENOSYS)
     throw std::runtime_error{"unexpected system call defined"};
 
-  while (controller.cont()) {
-    controller.measure_start();
-    syscall(fccmp::NR_SYS_NI_SYSCALL);
-    controller.print_end();
-  }
+  controller.measure([] { syscall(fccmp::NR_SYS_NI_SYSCALL); });
 }
+static Registrar syscall_registrar{"syscall", Kind::SAMPLES, benchmark_syscall};
 
 /* Benchmark the empty ioctl function of fccmp. */
 static void benchmark_ioctl(crtl::Controller &controller) {
-  int fd = open(fccmp::DEVICE_FILE, O_RDONLY);
+  int fd = fccmp::open_device();
   if (fd < 0)
     throw std::system_error{errno, std::generic_category()};
 
-  if (ioctl(fd, fccmp::IOCTL_NOOP))
+  if (fccmp::device_ioctl(fd, fccmp::IOCTL_NOOP))
     throw std::runtime_error{"ioctl noop failed"};
 
-  while (controller.cont()) {
-    controller.measure_start();
-    ioctl(fd, fccmp::IOCTL_NOOP);
-    controller.print_end();
-  }
+  controller.measure([&] { fccmp::device_ioctl(fd, fccmp::IOCTL_NOOP); });
+}
+static Registrar ioctl_registrar{"ioctl", Kind::SAMPLES, benchmark_ioctl};
+
+/* The scaling benchmark pins its own threads and needs no perf counters. */
+static Registrar scaling_registrar{"scaling", Kind::STANDALONE,
+                                   [](Params const &params) {
+                                     scaling::run(params.scaling);
+                                   }};
+
+/*
+ * Benchmarks compared by the report: the overhead benchmark first, then the
+ * selected sample-based benchmarks and the baseline.
+ */
+static std::vector<registry::Benchmark<crtl::Controller, Params> const *>
+report_selection(
+    std::vector<registry::Benchmark<crtl::Controller, Params> const *> const
+        &selected) {
+  auto reported =
+      registry::select<crtl::Controller, Params>({report::OVERHEAD});
+  for (auto benchmark : selected)
+    if (benchmark->kind != Kind::STANDALONE && benchmark != reported[0])
+      reported.push_back(benchmark);
+
+  auto baseline =
+      registry::select<crtl::Controller, Params>({report::BASELINE})[0];
+  if (std::find(reported.begin(), reported.end(), baseline) == reported.end())
+    reported.push_back(baseline);
+
+  return reported;
 }
 
 int main(int argc, char *argv[]) {
-  auto opt = options::parse_cmd(argc, argv);
-  auto pc = cycles::initialize_pc();
-  crtl::Controller controller{pc, opt.warmup_iters, opt.bench_iters};
-
-  if (opt.benchmark == "noop")
-    benchmark_noop(controller);
-  else if (opt.benchmark == "fastcall")
-    benchmark_fastcall(controller);
-  else if (opt.benchmark == "vdso")
-    benchmark_vdso(controller);
-  else if (opt.benchmark == "syscall")
-    benchmark_syscall(controller);
-  else if (opt.benchmark == "ioctl")
-    benchmark_ioctl(controller);
-  else {
-    std::cerr << "unknown benchmark " << opt.benchmark << std::endl;
+  namespace po = boost::program_options;
+
+  std::string event_list;
+  std::uint64_t batch;
+  std::string interference_mode;
+  std::string irq_event;
+  std::string aggressor_list;
+  bool report;
+  report::Config report_config;
+  Params params;
+  po::options_description desc("Cycles options");
+  desc.add_options()(
+      "events,e",
+      po::value<std::string>(&event_list)->default_value("cycles"),
+      "comma-separated perf events counted for every sample");
+  desc.add_options()(
+      "batch,B", po::value<std::uint64_t>(&batch)->default_value(1),
+      "also time this many back-to-back calls per sample and report the "
+      "amortized counts per call");
+  desc.add_options()(
+      "interference",
+      po::value<std::string>(&interference_mode)->default_value("off"),
+      "handle samples disturbed by context switches, page faults, migrations "
+      "or interrupts (off, tag or reject), costs a read system call before "
+      "and after every sample");
+  desc.add_options()(
+      "irq-event", po::value<std::string>(&irq_event),
+      "raw perf config counting hardware interrupts, e.g. 0x1cb on Intel");
+  desc.add_options()(
+      "aggressors", po::value<std::string>(&aggressor_list),
+      "also run every benchmark under these co-located aggressors (membw, "
+      "llc, syscall or tlb) and compare the tails to a quiet run");
+  desc.add_options()(
+      "report", po::bool_switch(&report),
+      "compare the benchmarks with noop subtracted and speedups relative to "
+      "syscall instead of printing samples");
+  desc.add_options()(
+      "resamples",
+      po::value<unsigned>(&report_config.resamples)->default_value(1000),
+      "bootstrap resamples for the report");
+  desc.add_options()(
+      "confidence",
+      po::value<double>(&report_config.confidence)->default_value(0.95),
+      "confidence level of the intervals in the report");
+  desc.add_options()(
+      "threads,n",
+      po::value<unsigned int>(&params.scaling.max_threads)->default_value(0),
+      "maximum number of threads for scaling (0 for all CPUs)");
+  desc.add_options()(
+      "duration,d",
+      po::value<double>(&params.scaling.duration)->default_value(1),
+      "seconds to measure each thread count for scaling");
+  desc.add_options()("array", po::bool_switch(&params.scaling.array),
+                     "use the array fastcall for scaling");
+  desc.add_options()("shared", po::bool_switch(&params.scaling.shared),
+                     "let all threads share one fastcall for scaling");
+  auto opt = options::parse_cmd(argc, argv, desc);
+
+  std::vector<registry::Benchmark<crtl::Controller, Params> const *> selected;
+  std::vector<perf::Event> events;
+  interference::Mode mode;
+  std::optional<std::uint64_t> irq_config;
+  std::vector<aggressor::Kind> aggressors;
+  try {
+    selected = registry::select<crtl::Controller, Params>(opt.benchmarks);
+    events = perf::parse_events(event_list);
+    mode = interference::parse_mode(interference_mode);
+    if (!irq_event.empty()) {
+      try {
+        irq_config = std::stoull(irq_event, nullptr, 0);
+      } catch (std::logic_error const &) {
+        // Also std::out_of_range for configs beyond 64 bits
+        throw std::invalid_argument{"invalid raw perf config " + irq_event};
+      }
+    }
+    if (!aggressor_list.empty())
+      aggressors = aggressor::parse(aggressor_list);
+    if (report && !aggressors.empty())
+      throw std::invalid_argument{"--report and --aggressors are exclusive"};
+    if (report)
+      selected = report_selection(selected);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << std::endl;
     return 1;
   }
+
+  if (opt.list) {
+    registry::list(std::cout, selected);
+    return 0;
+  }
+
+#ifdef FASTCALL_EMULATION
+  std::cerr << "fastcall backend: " << fce::BACKEND
+            << ", results exclude the kernel mechanism" << std::endl;
+#endif
+
+  if (!batch) {
+    std::cerr << "batch size must be positive" << std::endl;
+    return 1;
+  }
+
+  // The aggressors and the scaling threads may use all CPUs, not only the
+  // measured one, which the counters pin the process to.
+  auto cpus = os::allowed_cpus();
+  params.scaling.cpus = cpus;
+
+  // Open the counters once for all benchmarks which need them.
+  std::optional<cycles::perf_context> pc;
+  std::optional<interference::Monitor> monitor;
+  std::optional<perf::TimeConversion> clock;
+  for (auto benchmark : selected) {
+    if (!pc && benchmark->kind != Kind::STANDALONE) {
+      pc = cycles::initialize_pc(events);
+      monitor.emplace(mode, irq_config);
+      clock = cycles::arch_clock(*pc);
+      if (!clock)
+        std::cerr << "cannot convert clock ticks, omitting nanoseconds"
+                  << std::endl;
+    }
+  }
+  env::print(std::cout, env::fingerprint());
+
+  std::vector<std::string> names;
+  for (auto const &event : events)
+    names.push_back(event.name);
+  if (clock)
+    names.push_back("ns");
+
+  std::vector<std::string> columns{names};
+  if (batch > 1)
+    for (auto const &name : names)
+      columns.push_back(name + "_per_call_x" +
+                        std::to_string(crtl::PER_CALL_SCALE));
+  if (mode == interference::Mode::TAG)
+    columns.push_back("interference");
+
+  std::optional<std::size_t> cycles_event;
+  for (std::size_t i = 0; i < events.size(); i++)
+    if (std::string{events[i].name} == "cycles")
+      cycles_event = i;
+  frequency::Drift drift{cycles_event, cycles::CLOCK_UNIT};
+
+  // The report compares the first event, amortized if batched.
+  std::size_t report_column = batch > 1 ? names.size() : 0;
+  std::vector<report::Mechanism> mechanisms;
+
+  // Every benchmark runs quietly first, then under every aggressor.
+  std::vector<std::optional<aggressor::Kind>> noise{std::nullopt};
+  noise.insert(noise.end(), aggressors.begin(), aggressors.end());
+  bool collect = report || !aggressors.empty();
+  if (!aggressors.empty())
+    aggressor::print_header(std::cout, columns[report_column]);
+
+  bool multiple = selected.size() > 1 && !collect;
+  for (auto benchmark : selected) {
+    if (multiple)
+      registry::print_tag(std::cout, benchmark->name);
+
+    if (benchmark->kind == Kind::STANDALONE) {
+      try {
+        benchmark->standalone(params);
+      } catch (std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+      }
+      continue;
+    }
+
+    std::vector<std::pair<std::string, std::vector<std::uint64_t>>> runs;
+    for (auto kind : noise) {
+      std::unique_ptr<aggressor::Aggressor> noisy;
+      if (kind) {
+        int current = sched_getcpu();
+        if (current < 0) {
+          std::cerr << "cannot get current CPU, skipping the "
+                    << aggressor::name(*kind) << " aggressor: "
+                    << std::strerror(errno) << std::endl;
+          continue;
+        }
+        auto cpu = aggressor::choose_cpu(*kind, current, cpus);
+        if (!cpu) {
+          std::cerr << "no CPU for the " << aggressor::name(*kind)
+                    << " aggressor, skipping it" << std::endl;
+          continue;
+        }
+        noisy.reset(new aggressor::Aggressor{*kind, *cpu});
+      }
+
+      samples::Config config{opt.record, opt.summary,
+                             registry::trace_path(opt.trace, benchmark->name,
+                                                  multiple)};
+      if (collect)
+        config = {};
+      samples::Output output{
+          trace::make_header(benchmark->name,
+                             cycles::arch_counter_width(*pc), columns),
+          opt.bench_iters, config};
+      if (collect)
+        output.collect(report_column, opt.bench_iters);
+      crtl::Controller controller{*pc, clock, opt.warmup_iters,
+                                  opt.bench_iters, batch, output,
+                                  *monitor, drift};
+
+      benchmark->samples(controller, params);
+      controller.finish();
+
+      runs.emplace_back(kind ? aggressor::name(*kind) : "none",
+                        std::move(output.get_collected()));
+    }
+
+    if (report)
+      mechanisms.push_back({benchmark->name, std::move(runs[0].second)});
+    else if (!aggressors.empty())
+      aggressor::print(std::cout, benchmark->name, runs);
+  }
+
+  if (report)
+    report::print(std::cout, mechanisms, columns[report_column],
+                  report_config);
 }
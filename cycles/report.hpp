@@ -0,0 +1,119 @@
+/*
+ * Comparison of the mechanisms with bootstrap confidence intervals.
+ */
+
+#pragma once
+
+#include "stats.hpp"
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace report {
+
+/* Benchmark measuring the overhead which is subtracted from all others */
+static const char OVERHEAD[] = "noop";
+/* Benchmark all others are compared to */
+static const char BASELINE[] = "syscall";
+
+/* Percentiles reported for every mechanism */
+static const std::array<std::pair<char const *, double>, 3> PERCENTILES{{
+    {"median", 50},
+    {"p90", 90},
+    {"p99", 99},
+}};
+
+struct Config {
+  /* Number of bootstrap replicates */
+  unsigned resamples;
+  /* Confidence level of the intervals, e.g. 0.95 */
+  double confidence;
+};
+
+/*
+ * Samples of one benchmark.
+ */
+struct Mechanism {
+  std::string name;
+  std::vector<std::uint64_t> samples;
+};
+
+static inline std::size_t find(std::vector<Mechanism> const &mechanisms,
+                               char const *name) {
+  for (std::size_t i = 0; i < mechanisms.size(); i++)
+    if (mechanisms[i].name == name)
+      return i;
+  return mechanisms.size();
+}
+
+/*
+ * Print the overhead-corrected percentiles of all mechanisms and their
+ * speedup relative to the baseline.
+ *
+ * The median of the overhead benchmark is subtracted from all percentiles.
+ * The speedup is the ratio of the corrected medians of the baseline and a
+ * mechanism. The overhead and baseline benchmarks must be in mechanisms.
+ */
+static void print(std::ostream &out, std::vector<Mechanism> const &mechanisms,
+                  std::string const &unit, Config const &config) {
+  std::size_t overhead = find(mechanisms, OVERHEAD);
+  std::size_t baseline = find(mechanisms, BASELINE);
+  std::size_t count = mechanisms.size();
+
+  std::vector<std::vector<std::uint64_t>> sets;
+  for (auto const &mechanism : mechanisms)
+    sets.push_back(mechanism.samples);
+
+  // Statistics: all percentiles of every mechanism, then all speedups
+  auto statistics = [&](std::vector<std::vector<std::uint64_t>> &resampled) {
+    double noop = stats::percentile(resampled[overhead], 50);
+
+    std::vector<double> values;
+    for (std::size_t i = 0; i < count; i++)
+      for (auto const &percentile : PERCENTILES)
+        values.push_back(stats::percentile(resampled[i], percentile.second) -
+                         noop);
+
+    double base = values[baseline * PERCENTILES.size()];
+    for (std::size_t i = 0; i < count; i++) {
+      double median = values[i * PERCENTILES.size()];
+      values.push_back(median > 0 ? base / median
+                                  : std::numeric_limits<double>::infinity());
+    }
+    return values;
+  };
+
+  auto intervals = stats::bootstrap(sets, statistics, config.resamples,
+                                    config.confidence);
+
+  out << "# " << unit << " minus the " << OVERHEAD << " median, "
+      << config.confidence * 100 << "% bootstrap confidence intervals ("
+      << config.resamples << " resamples)\n";
+  out << "mechanism,statistic,estimate,low,high\n";
+  for (std::size_t i = 0; i < count; i++) {
+    if (i == overhead)
+      continue;
+    for (std::size_t j = 0; j < PERCENTILES.size(); j++) {
+      auto const &interval = intervals[i * PERCENTILES.size() + j];
+      out << mechanisms[i].name << ',' << PERCENTILES[j].first << ','
+          << interval.estimate << ',' << interval.low << ',' << interval.high
+          << '\n';
+    }
+  }
+
+  out << "mechanism,speedup_vs_" << BASELINE << ",low,high\n";
+  for (std::size_t i = 0; i < count; i++) {
+    if (i == overhead)
+      continue;
+    auto const &interval = intervals[count * PERCENTILES.size() + i];
+    out << mechanisms[i].name << ',' << interval.estimate << ','
+        << interval.low << ',' << interval.high << '\n';
+  }
+  out.flush();
+}
+
+} // namespace report
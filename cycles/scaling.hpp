@@ -0,0 +1,142 @@
+/*
+ * Throughput scaling of fastcall invocations over multiple threads.
+ */
+
+#pragma once
+
+#include "fce.hpp"
+#include "os.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace scaling {
+
+using std::chrono::steady_clock;
+
+static const std::size_t CACHE_LINE = 64;
+
+struct Config {
+  /* Largest number of threads, 0 for all allowed CPUs */
+  unsigned int max_threads;
+  /* Measurement duration per thread count in seconds */
+  double duration;
+  /* Use the array instead of the noop fastcall */
+  bool array;
+  /* All threads invoke the same registered fastcall */
+  bool shared;
+  /* CPUs the threads may run on, captured before the process is pinned */
+  std::vector<unsigned int> cpus;
+};
+
+/*
+ * Result of one thread, padded to a cache line to avoid false sharing.
+ */
+struct alignas(CACHE_LINE) Result {
+  unsigned int cpu;
+  std::uint64_t calls;
+  double seconds;
+};
+
+/*
+ * Invoke a fastcall on cpu until stop is set.
+ */
+static void worker(unsigned int cpu, unsigned int index, bool array,
+                   std::atomic<unsigned int> &ready,
+                   std::atomic<bool> const &go, std::atomic<bool> const &stop,
+                   Result &result) {
+  if (!os::pin_cpu(cpu))
+    std::cerr << "cannot pin thread to CPU " << cpu << ": "
+              << std::strerror(errno) << '\n';
+
+  ready.fetch_add(1);
+  while (!go.load(std::memory_order_acquire))
+    ;
+
+  std::uint64_t calls = 0;
+  auto start = steady_clock::now();
+  if (array) {
+    while (!stop.load(std::memory_order_relaxed)) {
+      fce::fastcall_syscall(index, 0, fce::DATA_SIZE);
+      calls++;
+    }
+  } else {
+    while (!stop.load(std::memory_order_relaxed)) {
+      fce::fastcall_syscall(index);
+      calls++;
+    }
+  }
+  std::chrono::duration<double> elapsed{steady_clock::now() - start};
+
+  result.cpu = cpu;
+  result.calls = calls;
+  result.seconds = elapsed.count();
+}
+
+/*
+ * Measure the throughput of 1 to max_threads threads pinned to distinct CPUs.
+ *
+ * Prints the calls per second of every thread and the sum over all threads
+ * as CSV. The time of the sum is the longest time of any thread.
+ */
+static void run(Config const &config) {
+  auto const &cpus = config.cpus;
+  if (cpus.empty())
+    throw std::runtime_error{"no CPUs available"};
+
+  unsigned int max_threads = config.max_threads;
+  if (!max_threads || max_threads > cpus.size())
+    max_threads = cpus.size();
+
+  fce::ManyFastcalls fastcalls{config.array ? fce::Fill::ARRAY
+                                             : fce::Fill::NOOP,
+                               config.shared ? 1 : max_threads};
+
+  std::cout << "threads,thread,cpu,calls,seconds,calls_per_second\n";
+  for (unsigned int threads = 1; threads <= max_threads; threads++) {
+    std::unique_ptr<Result[]> results{new Result[threads]};
+    std::atomic<unsigned int> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++) {
+      unsigned int index = fastcalls.index(config.shared ? 0 : i);
+      workers.emplace_back(worker, cpus[i], index, config.array,
+                           std::ref(ready), std::cref(go), std::cref(stop),
+                           std::ref(results[i]));
+    }
+
+    while (ready.load() < threads)
+      std::this_thread::yield();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.duration));
+    stop.store(true, std::memory_order_relaxed);
+    for (auto &thread : workers)
+      thread.join();
+
+    std::uint64_t total_calls = 0;
+    double total_rate = 0, seconds = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+      auto const &result = results[i];
+      double rate = result.calls / result.seconds;
+      total_calls += result.calls;
+      total_rate += rate;
+      seconds = std::max(seconds, result.seconds);
+      std::cout << threads << ',' << i << ',' << result.cpu << ','
+                << result.calls << ',' << result.seconds << ',' << rate
+                << '\n';
+    }
+    std::cout << threads << ",all,," << total_calls << ',' << seconds << ','
+              << total_rate << std::endl;
+  }
+}
+
+} // namespace scaling
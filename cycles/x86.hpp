@@ -1,80 +1,146 @@
 /*
  * x86-specific implementation for low-overhead, user-space reads of the
- * cycle counter with RDPMC.
+ * performance counters with RDPMC.
+ *
+ * The elapsed time is taken from the TSC and converted to nanoseconds with
+ * the conversion the kernel publishes in the perf page.
  */
 
 #pragma once
 
 #include "compiler.hpp"
 #include "perf.hpp"
+#include <array>
 #include <linux/perf_event.h>
 #include <optional>
 #include <sys/mman.h>
 #include <system_error>
 #include <unistd.h>
+#include <vector>
 #include <x86intrin.h>
 
 namespace cycles {
 
-typedef perf_event_mmap_page const *perf_context;
+/*
+ * Open the counters, RDPMC is allowed without requesting it.
+ */
+static inline std::vector<int>
+arch_open_counters(std::vector<perf::Event> const &events) {
+  return perf::initialize(events);
+}
+
+typedef std::array<std::uint64_t, perf::MAX_EVENTS> counts_t;
+
+/* Unit of the clock ticks */
+static const char CLOCK_UNIT[] = "TSC tick";
+
+/*
+ * Elapsed counts of all events and elapsed clock ticks.
+ */
+struct elapsed_t {
+  counts_t counts;
+  std::uint64_t ticks;
+};
+
+/*
+ * Perf pages of all counted events.
+ */
+struct perf_context {
+  std::size_t events;
+  std::array<perf_event_mmap_page const *, perf::MAX_EVENTS> pages;
+};
+
+/*
+ * Map the perf pages of all events to user space.
+ */
+static inline perf_context arch_init_counter(std::vector<int> const &fds) {
+  perf_context pc{fds.size(), {}};
+  for (std::size_t i = 0; i < fds.size(); i++)
+    pc.pages[i] = perf::mmap(fds[i]);
+  return pc;
+}
+
+/*
+ * Return the width of the hardware counters in bits.
+ */
+static inline std::uint8_t arch_counter_width(perf_context const &pc) {
+  return pc.pages[0]->pmc_width;
+}
 
 /*
- * Map perf page to user space.
+ * Return the conversion of TSC ticks to nanoseconds, if available.
  */
-static inline perf_context arch_init_counter(int fd) { return perf::mmap(fd); }
+static inline std::optional<perf::TimeConversion>
+arch_clock(perf_context const &pc) {
+  return perf::time_conversion(pc.pages[0]);
+}
 
 /*
- * Read the current cycle counter value with RDPMC.
+ * Read the current values of all counters with RDPMC.
  *
- * If the reading the perf page gets interrupted by some modification,
- * no cycle count is returned.
+ * All counters are read in one section protected by the sequence locks of
+ * all perf pages. If this gets interrupted by some modification, no counts
+ * are returned.
  */
-static INLINE std::optional<std::uint64_t> perf_cycles(perf_context pc) {
-  std::uint64_t cycles;
+static INLINE bool perf_counts(perf_context const &pc, counts_t &counts) {
+  std::array<std::uint32_t, perf::MAX_EVENTS> seq;
 
   compiler::serialize();
 
   // Loads are not reordered with other loads on x86.
-  std::uint32_t seq = compiler::read_once(pc->lock);
+  for (std::size_t i = 0; i < pc.events; i++)
+    seq[i] = compiler::read_once(pc.pages[i]->lock);
   compiler::barrier();
 
-  std::uint32_t idx = pc->index;
-  if (!pc->cap_user_rdpmc || !idx)
-    throw std::runtime_error("cannot read performance counter");
+  for (std::size_t i = 0; i < pc.events; i++) {
+    auto page = pc.pages[i];
+    std::uint32_t idx = page->index;
+    if (!page->cap_user_rdpmc || !idx)
+      throw std::runtime_error("cannot read performance counter");
 
-  cycles = _rdpmc(idx - 1) & (((std::uint64_t)1 << pc->pmc_width) - 1);
+    counts[i] =
+        _rdpmc(idx - 1) & (((std::uint64_t)1 << page->pmc_width) - 1);
+  }
 
   compiler::barrier();
-  if (seq != compiler::read_once(pc->lock))
-    return std::nullopt;
+  for (std::size_t i = 0; i < pc.events; i++)
+    if (seq[i] != compiler::read_once(pc.pages[i]->lock))
+      return false;
 
   compiler::serialize();
-  return {cycles};
+  return true;
 }
 
-typedef std::uint64_t cycles_t;
+typedef elapsed_t cycles_t;
 
 /*
- * Read the performance counter until a valid result is obtained.
+ * Read the performance counters until a valid result is obtained.
+ *
+ * The TSC is read before the counters here and after them in arch_end, so
+ * its reads are not counted.
  */
-static INLINE cycles_t arch_start(perf_context pc) {
-  std::optional<std::uint64_t> start;
-  do {
-    start = perf_cycles(pc);
-  } while (!start);
-  return *start;
+static INLINE cycles_t arch_start(perf_context const &pc) {
+  cycles_t start;
+  do
+    start.ticks = __rdtsc();
+  while (!perf_counts(pc, start.counts));
+  return start;
 }
 
 /*
- * Calculate the elapsed cycles.
+ * Calculate the elapsed counts of all events and the elapsed TSC ticks.
  */
-static INLINE std::optional<std::uint64_t> arch_end(perf_context pc,
-                                                    cycles_t start) {
-  auto end = perf_cycles(pc);
-  if (!end)
-    return end;
+static INLINE std::optional<elapsed_t> arch_end(perf_context const &pc,
+                                                cycles_t const &start) {
+  elapsed_t end;
+  if (!perf_counts(pc, end.counts))
+    return std::nullopt;
+  end.ticks = __rdtsc();
 
-  return *end - start;
+  for (std::size_t i = 0; i < pc.events; i++)
+    end.counts[i] -= start.counts[i];
+  end.ticks -= start.ticks;
+  return end;
 }
 
 } // namespace cycles
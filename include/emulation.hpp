@@ -0,0 +1,44 @@
+/*
+ * Helpers shared by the user-space stand-ins for fastcall and fccmp.
+ *
+ * Only included by fce_emulation.hpp and fccmp_emulation.hpp.
+ */
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+
+namespace emulation {
+
+/*
+ * Fail like a system call with the error number err.
+ */
+static inline long fail(int err) {
+  errno = err;
+  return -1;
+}
+
+/*
+ * Copy len bytes, a multiple of 8, with non-temporal stores if available.
+ */
+static inline void copy_nt(char *to, char const *from, std::size_t len) {
+#ifdef __x86_64__
+  for (std::size_t i = 0; i < len; i += sizeof(long long)) {
+    long long value;
+    std::memcpy(&value, from + i, sizeof(value));
+    __builtin_ia32_movnti64(reinterpret_cast<long long *>(to + i), value);
+  }
+  __builtin_ia32_sfence();
+#else
+  std::memcpy(to, from, len);
+#endif
+}
+
+/*
+ * Open a file descriptor standing in for a device driver.
+ */
+static inline int open_device() { return open("/dev/null", O_RDONLY); }
+
+} // namespace emulation
@@ -0,0 +1,136 @@
+/*
+ * Fingerprint of the conditions a benchmark runs under.
+ *
+ * Every executable records the fingerprint with its results, so that numbers
+ * from different hosts or configurations can be told apart.
+ */
+#pragma once
+
+#include "os.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <sched.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace env {
+
+typedef std::vector<std::pair<std::string, std::string>> Fingerprint;
+
+static const char CPU_DIR[] = "/sys/devices/system/cpu/";
+static const char VULNERABILITIES_DIR[] =
+    "/sys/devices/system/cpu/vulnerabilities/";
+static const char UNKNOWN[] = "unknown";
+
+/* Return the first line of a file or an empty string. */
+static inline std::string read_line(std::string const &path) {
+  std::ifstream file{path};
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+/* Return value or unknown if it is empty. */
+static inline std::string known(std::string const &value) {
+  return value.empty() ? UNKNOWN : value;
+}
+
+/* Return the current CPU and whether the thread is pinned to it. */
+static inline std::string cpu(int cpu) {
+  if (cpu < 0)
+    return UNKNOWN;
+  bool pinned = os::allowed_cpus().size() == 1;
+  return std::to_string(cpu) + (pinned ? " (pinned)" : " (unpinned)");
+}
+
+/* Return whether turbo/boost frequencies are enabled. */
+static inline std::string turbo() {
+  // intel_pstate inverts the meaning, acpi-cpufreq and amd-pstate do not.
+  std::string no_turbo =
+      read_line(std::string{CPU_DIR} + "intel_pstate/no_turbo");
+  if (!no_turbo.empty())
+    return no_turbo == "0" ? "on" : "off";
+
+  std::string boost = read_line(std::string{CPU_DIR} + "cpufreq/boost");
+  if (!boost.empty())
+    return boost == "1" ? "on" : "off";
+
+  return UNKNOWN;
+}
+
+/* Return whether kernel page-table isolation is active. */
+static inline std::string kpti(std::string const &meltdown) {
+  if (meltdown.empty())
+    return UNKNOWN;
+  return meltdown.find("PTI") != std::string::npos ? "on" : "off";
+}
+
+/* Return a CPU list from sysfs, empty lists meaning none. */
+static inline std::string cpu_list(char const *name) {
+  std::string path = std::string{CPU_DIR} + name;
+  if (!std::filesystem::exists(path))
+    return UNKNOWN;
+
+  std::string list = read_line(path);
+  return list.empty() || list == "(null)" ? "none" : list;
+}
+
+/*
+ * Collect the fingerprint of the running system and the calling thread.
+ *
+ * Values which cannot be determined are reported as unknown.
+ */
+static inline Fingerprint fingerprint() {
+  Fingerprint fingerprint;
+  int current = sched_getcpu();
+
+  fingerprint.emplace_back("kernel", os::kernel_release());
+  fingerprint.emplace_back("cpu_model", os::cpu_model());
+  fingerprint.emplace_back("microcode", known(os::cpuinfo("microcode")));
+  fingerprint.emplace_back("cpu", cpu(current));
+
+  std::string governor;
+  if (current >= 0)
+    governor = read_line(std::string{CPU_DIR} + "cpu" +
+                         std::to_string(current) +
+                         "/cpufreq/scaling_governor");
+  fingerprint.emplace_back("governor", known(governor));
+  fingerprint.emplace_back("turbo", turbo());
+  fingerprint.emplace_back(
+      "smt", known(read_line(std::string{CPU_DIR} + "smt/control")));
+  fingerprint.emplace_back("isolcpus", cpu_list("isolated"));
+  fingerprint.emplace_back("nohz_full", cpu_list("nohz_full"));
+  fingerprint.emplace_back(
+      "perf_event_paranoid",
+      known(read_line("/proc/sys/kernel/perf_event_paranoid")));
+
+  std::vector<std::string> vulnerabilities;
+  std::error_code error;
+  for (auto const &entry :
+       std::filesystem::directory_iterator{VULNERABILITIES_DIR, error})
+    vulnerabilities.push_back(entry.path().filename());
+  std::sort(vulnerabilities.begin(), vulnerabilities.end());
+
+  fingerprint.emplace_back(
+      "kpti", kpti(read_line(std::string{VULNERABILITIES_DIR} + "meltdown")));
+  for (auto const &name : vulnerabilities)
+    fingerprint.emplace_back(
+        "vulnerability." + name,
+        known(read_line(std::string{VULNERABILITIES_DIR} + name)));
+
+  return fingerprint;
+}
+
+/*
+ * Print the fingerprint as comment lines.
+ */
+static inline void print(std::ostream &out, Fingerprint const &fingerprint) {
+  for (auto const &[key, value] : fingerprint)
+    out << "# " << key << ": " << value << '\n';
+  out.flush();
+}
+
+} // namespace env
@@ -4,7 +4,10 @@
 #pragma once
 
 #include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #ifdef __aarch64__
@@ -28,7 +31,7 @@ struct array_args {
   unsigned index;
 };
 
-static const char *DEVICE_FILE = "/dev/fastcall-examples";
+static const char DEVICE_FILE[] = "/dev/fastcall-examples";
 static const unsigned char TYPE = 0xDE;
 static constexpr unsigned fce_ioctl(unsigned char cmd) {
   return _IOR(TYPE, cmd, struct ioctl_args);
@@ -43,11 +46,66 @@ static const unsigned IOCTL_ARRAY = ioctl_array(3);
 static const unsigned IOCTL_NT = ioctl_array(4);
 static const unsigned DATA_SIZE = 64;
 static const unsigned ARRAY_SIZE = 64;
+/* Fastcall slots of a process, index 255 (-1) is never handed out. */
+static const std::size_t TABLE_SIZE = 255;
+
+} // namespace fce
+
+#ifdef FASTCALL_EMULATION
+#include "fce_emulation.hpp"
+#endif
+
+namespace fce {
+
+/* Backend executing fastcalls, reported with the results */
+#ifdef FASTCALL_EMULATION
+static const char BACKEND[] = "emulation";
+#else
+static const char BACKEND[] = "kernel";
+#endif
+
+/*
+ * Open the fastcall-examples device driver.
+ */
+static inline int open_device() {
+#ifdef FASTCALL_EMULATION
+  return emu::open_device();
+#else
+  return open(DEVICE_FILE, O_RDONLY);
+#endif
+}
+
+/*
+ * Register a fastcall-examples function with one of the IOCTL_* types.
+ */
+static inline int register_fastcall(int fd, unsigned type, void *args) {
+#ifdef FASTCALL_EMULATION
+  (void)fd;
+  return emu::ioctl(type, args);
+#else
+  return ioctl(fd, type, args);
+#endif
+}
+
+/*
+ * Deregister a fastcall by unmapping its function.
+ */
+static inline int deregister_mapping(unsigned long fn_addr,
+                                     unsigned long fn_len) {
+#ifdef FASTCALL_EMULATION
+  return emu::deregister(fn_addr, fn_len);
+#else
+  return munmap(reinterpret_cast<void *>(fn_addr), fn_len);
+#endif
+}
 
 template <class... Args>
 static inline long fastcall_syscall(unsigned char fastcall_number,
                                     Args... arguments) {
-#ifdef __aarch64__
+#if defined(FASTCALL_EMULATION)
+  return emu::invoke(fastcall_number,
+                     static_cast<unsigned long>(arguments)...);
+#elif defined(__aarch64__)
   long result = invoke_fastcall(fastcall_number, arguments...);
   if (result < 0 && result >= -4095) {
     errno = -result;
@@ -4,20 +4,13 @@
 #pragma once
 
 #include <cstdint>
+#include <fcntl.h>
 #include <sys/ioctl.h>
+#include <type_traits>
 #include <unistd.h>
 
-extern "C" void vdso_init_from_sysinfo_ehdr(uintptr_t base);
-extern "C" void *vdso_sym(const char *version, const char *name);
-
 namespace fccmp {
 
-#ifdef __aarch64__
-static const char VDSO_VERSION[] = "LINUX_2.6.39";
-#else
-static const char VDSO_VERSION[] = "LINUX_2.6";
-#endif
-
 struct array_args {
   const char *data;
   unsigned char index;
@@ -54,3 +47,60 @@ static const char VDSO_COPY_NT[] = "__vdso_fccmp_copy_nt";
 typedef long VDSO_COPY_NT_TYPE(char *to, const char *from, unsigned char index);
 
 } // namespace fccmp
+
+#ifdef FASTCALL_EMULATION
+#include "fccmp_emulation.hpp"
+#endif
+
+namespace fccmp {
+
+/*
+ * Open the fccmp device driver.
+ */
+static inline int open_device() {
+#ifdef FASTCALL_EMULATION
+  return emu::open_device();
+#else
+  return open(DEVICE_FILE, O_RDWR);
+#endif
+}
+
+/*
+ * Invoke an ioctl of fccmp.
+ */
+static inline int device_ioctl(int fd, unsigned cmd,
+                               const void *args = nullptr) {
+#ifdef FASTCALL_EMULATION
+  (void)fd;
+  return emu::ioctl(cmd, args);
+#else
+  return ioctl(fd, cmd, args);
+#endif
+}
+
+#ifdef FASTCALL_EMULATION
+template <class T> static inline unsigned long syscall_arg(T value) {
+  if constexpr (std::is_pointer_v<T>)
+    return reinterpret_cast<unsigned long>(value);
+  else
+    return static_cast<unsigned long>(value);
+}
+#endif
+
+/*
+ * Invoke one of the fccmp system calls or sys_ni_syscall.
+ *
+ * sys_ni_syscall is always a real system call, it exists on stock kernels.
+ */
+template <class... Args>
+static inline long fccmp_syscall(long nr, Args... arguments) {
+#ifdef FASTCALL_EMULATION
+  long result;
+  unsigned long args[] = {syscall_arg(arguments)..., 0, 0, 0};
+  if (emu::syscall(nr, result, args[0], args[1], args[2]))
+    return result;
+#endif
+  return syscall(nr, arguments...);
+}
+
+} // namespace fccmp
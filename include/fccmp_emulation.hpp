@@ -0,0 +1,93 @@
+/*
+ * User-space stand-in for the fccmp system calls, ioctls and vDSO functions.
+ *
+ * Only included by fccmp.hpp for builds with FASTCALL_EMULATION. The
+ * functions copy into a process-wide array like the kernel module does and
+ * are never inlined to keep the cost of a function call.
+ */
+#pragma once
+
+#include "emulation.hpp"
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#define NOINLINE static inline __attribute__((noinline))
+
+namespace fccmp::emu {
+
+/* Stand-in for the array of the kernel module, 4096 bytes like a page */
+alignas(64) inline char array[4096];
+
+using emulation::fail;
+using emulation::open_device;
+
+NOINLINE long noop() { return 0; }
+
+NOINLINE long copy_array(char *to, const char *from, unsigned char index,
+                         unsigned long size) {
+  if (index >= ARRAY_LENGTH || size > DATA_SIZE)
+    return fail(EINVAL);
+  std::memcpy(to + index * DATA_SIZE, from, size);
+  return 0;
+}
+
+NOINLINE long copy_nt_array(char *to, const char *from,
+                            unsigned char index) {
+  if (index >= ARRAY_LENGTH)
+    return fail(EINVAL);
+  emulation::copy_nt(to + index * DATA_SIZE, from, DATA_SIZE);
+  return 0;
+}
+
+/*
+ * Emulate the ioctls of fccmp.
+ */
+NOINLINE int ioctl(unsigned cmd, const void *argp) {
+  if (cmd == IOCTL_NOOP)
+    return noop();
+
+  if (cmd == IOCTL_ARRAY) {
+    auto args = static_cast<array_args const *>(argp);
+    return copy_array(array, args->data, args->index, args->size);
+  }
+
+  if (cmd == IOCTL_NT) {
+    auto args = static_cast<array_nt_args const *>(argp);
+    return copy_nt_array(array, args->data, args->index);
+  }
+
+  return fail(ENOTTY);
+}
+
+/*
+ * Emulate the system calls of fccmp, returns false for other numbers.
+ */
+NOINLINE bool syscall(long nr, long &result, unsigned long arg0,
+                      unsigned long arg1, unsigned long arg2) {
+  auto data = reinterpret_cast<const char *>(arg0);
+  if (nr == NR_ARRAY)
+    result = copy_array(array, data, arg1, arg2);
+  else if (nr == NR_NT)
+    result = copy_nt_array(array, data, arg1);
+  else
+    return false;
+  return true;
+}
+
+/*
+ * Look up an emulated vDSO function.
+ */
+static inline void *vdso_sym(const char *name) {
+  if (std::string{name} == VDSO_NOOP)
+    return reinterpret_cast<void *>(noop);
+  if (std::string{name} == VDSO_COPY_ARRAY)
+    return reinterpret_cast<void *>(copy_array);
+  if (std::string{name} == VDSO_COPY_NT)
+    return reinterpret_cast<void *>(copy_nt_array);
+  return nullptr;
+}
+
+} // namespace fccmp::emu
+
+#undef NOINLINE
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "fastcall.hpp"
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace fce {
+
+static const unsigned FORK_FASTCALL_COUNT = 100;
+
+/*
+ * Base exception for the fce namespace.
+ */
+class Error : public std::exception {
+public:
+  Error(std::string msg) : msg{msg} {}
+  virtual const char *what() const throw() { return msg.c_str(); }
+
+private:
+  std::string msg;
+};
+
+/*
+ * An error described by an errno.
+ */
+template <const char *Prefix> class ErrnoError : public Error {
+public:
+  ErrnoError(int nr) : Error(get_msg(nr)) {}
+
+private:
+  /*
+   * Create a error message from the error number nr.
+   */
+  static std::string get_msg(int nr) {
+    std::stringstream st{};
+    st << Prefix << ": " << std::strerror(nr);
+    return st.str();
+  }
+};
+
+const char FDMsg[]{"failed to open device driver"};
+const char IOCTLError[]{"ioctl failed"};
+
+/*
+ * Manage a file descriptor with the RAII principle.
+ */
+class FileDescriptor {
+public:
+  FileDescriptor() : fd{open_device()} {
+    if (fd < 0) {
+      throw ErrnoError<FDMsg>(errno);
+    }
+  }
+  ~FileDescriptor() {
+    if (close(fd) < 0)
+      std::cerr << "failed to close device driver: " << std::strerror(errno)
+                << '\n';
+  }
+
+  /*
+   * ioctl function for the wrapped file descriptor.
+   */
+  void io(unsigned type, void *args) {
+    if (register_fastcall(fd, type, args) < 0) {
+      throw ErrnoError<IOCTLError>{errno};
+    }
+  }
+
+private:
+  int fd;
+};
+
+const char MunmapMsg[]{"fce munmap failed"};
+
+template <typename Args>
+static void __attribute__((always_inline)) inline deregister(Args &args) {
+  if (deregister_mapping(args.fn_addr, args.fn_len) < 0) {
+    throw ErrnoError<MunmapMsg>{errno};
+  }
+}
+
+/*
+ * Kind of fastcalls registered by ManyFastcalls.
+ */
+enum class Fill {
+  NOOP,
+  ARRAY,
+  /* Alternate between array and noop fastcalls */
+  MIXED,
+};
+
+const char FillMsg[]{"unknown fastcall kind (noop, array or mixed)"};
+
+static inline Fill parse_fill(std::string const &name) {
+  if (name == "noop")
+    return Fill::NOOP;
+  else if (name == "array")
+    return Fill::ARRAY;
+  else if (name == "mixed")
+    return Fill::MIXED;
+  throw Error{FillMsg};
+}
+
+/*
+ * Registers a lot of fastcalls until deconstruction.
+ *
+ * The number of registered fastcalls can be changed with resize().
+ */
+class ManyFastcalls {
+public:
+  ManyFastcalls(Fill fill = Fill::ARRAY,
+                std::size_t count = FORK_FASTCALL_COUNT)
+      : fill{fill} {
+    resize(count);
+  }
+  ~ManyFastcalls() {
+    try {
+      resize(0);
+    } catch (Error &e) {
+      std::cerr << e.what() << '\n';
+    }
+  }
+
+  /*
+   * Register or deregister fastcalls until count fastcalls are registered.
+   */
+  void resize(std::size_t count) {
+    while (mappings.size() > count) {
+      fce::deregister(mappings.back());
+      mappings.pop_back();
+    }
+
+    mappings.reserve(count);
+    while (mappings.size() < count) {
+      bool array = fill == Fill::ARRAY ||
+                   (fill == Fill::MIXED && mappings.size() % 2 == 0);
+      if (array) {
+        fce::array_args args;
+        fd.io(fce::IOCTL_ARRAY, &args);
+        mappings.push_back({args.fn_addr, args.fn_len, args.index});
+      } else {
+        fce::ioctl_args args;
+        fd.io(fce::IOCTL_NOOP, &args);
+        mappings.push_back({args.fn_addr, args.fn_len, args.index});
+      }
+    }
+  }
+
+  std::size_t size() const { return mappings.size(); }
+
+  /* Fastcall number of the registered fastcall i */
+  unsigned int index(std::size_t i) const { return mappings[i].index; }
+
+private:
+  /* Information needed for invocation and deregistration */
+  struct Mapping {
+    unsigned long fn_addr;
+    unsigned long fn_len;
+    unsigned int index;
+  };
+
+  fce::FileDescriptor fd{};
+  Fill fill;
+  std::vector<Mapping> mappings;
+};
+
+} // namespace fce
@@ -0,0 +1,184 @@
+/*
+ * User-space stand-in for the fastcall mechanism and the fastcall-examples
+ * driver.
+ *
+ * Only included by fastcall.hpp for builds with FASTCALL_EMULATION.
+ * Registered functions are kept in a dispatch table indexed by the fastcall
+ * number. Like with the kernel, the function is represented by a mapping
+ * (fn_addr, fn_len), which has to be passed to deregister().
+ */
+#pragma once
+
+#include "emulation.hpp"
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define NOINLINE static inline __attribute__((noinline))
+
+namespace fce::emu {
+
+/* Kinds of emulated fastcall-examples functions */
+enum Kind : unsigned {
+  FREE,
+  NOOP,
+  STACK,
+  PRIV,
+  ARRAY,
+  NT,
+};
+
+/* Alignment of the private array for non-temporal stores */
+static const std::size_t NT_ALIGN = 64;
+
+/*
+ * Entry of the dispatch table.
+ */
+struct Slot {
+  std::atomic<unsigned> kind{FREE};
+  unsigned long fn_addr, fn_len;
+  char *shared;
+  /* Array of ARRAY_SIZE entries of DATA_SIZE bytes */
+  char *array;
+};
+
+/* As many slots as in the kernel, see fce::TABLE_SIZE */
+inline std::array<Slot, TABLE_SIZE> table;
+inline std::mutex table_lock;
+
+using emulation::fail;
+using emulation::open_device;
+
+static inline void *map_page(int prot) {
+  return mmap(nullptr, getpagesize(), prot, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+              0);
+}
+
+/*
+ * Emulate the registration ioctls of fastcall-examples.
+ */
+static inline int ioctl(unsigned type, void *argp) {
+  Kind kind;
+  if (type == IOCTL_NOOP)
+    kind = NOOP;
+  else if (type == IOCTL_STACK)
+    kind = STACK;
+  else if (type == IOCTL_PRIV)
+    kind = PRIV;
+  else if (type == IOCTL_ARRAY)
+    kind = ARRAY;
+  else if (type == IOCTL_NT)
+    kind = NT;
+  else
+    return fail(ENOTTY);
+
+  std::lock_guard<std::mutex> guard{table_lock};
+
+  std::size_t index = 0;
+  while (index < TABLE_SIZE && table[index].kind.load() != FREE)
+    index++;
+  if (index == TABLE_SIZE)
+    return fail(ENOMEM);
+  Slot &slot = table[index];
+
+  void *fn = map_page(PROT_READ);
+  if (fn == MAP_FAILED)
+    return -1;
+  slot.fn_addr = reinterpret_cast<unsigned long>(fn);
+  slot.fn_len = getpagesize();
+  slot.shared = nullptr;
+  slot.array = nullptr;
+
+  if (kind == ARRAY || kind == NT) {
+    void *shared = map_page(PROT_READ | PROT_WRITE);
+    if (shared == MAP_FAILED) {
+      munmap(fn, slot.fn_len);
+      return -1;
+    }
+    slot.shared = static_cast<char *>(shared);
+    slot.array = static_cast<char *>(
+        std::aligned_alloc(NT_ALIGN, ARRAY_SIZE * DATA_SIZE));
+    if (!slot.array) {
+      munmap(shared, getpagesize());
+      munmap(fn, slot.fn_len);
+      return fail(ENOMEM);
+    }
+
+    auto args = static_cast<array_args *>(argp);
+    args->fn_addr = slot.fn_addr;
+    args->fn_len = slot.fn_len;
+    args->shared_addr = slot.shared;
+    args->index = index;
+  } else {
+    auto args = static_cast<ioctl_args *>(argp);
+    args->fn_addr = slot.fn_addr;
+    args->fn_len = slot.fn_len;
+    args->index = index;
+  }
+
+  slot.kind.store(kind, std::memory_order_release);
+  return 0;
+}
+
+/*
+ * Remove the fastcall owning the function mapping and unmap it.
+ */
+static inline int deregister(unsigned long fn_addr, unsigned long fn_len) {
+  std::lock_guard<std::mutex> guard{table_lock};
+
+  for (auto &slot : table) {
+    if (slot.kind.load() == FREE || slot.fn_addr != fn_addr)
+      continue;
+
+    slot.kind.store(FREE);
+    if (slot.shared)
+      munmap(slot.shared, getpagesize());
+    std::free(slot.array);
+    break;
+  }
+
+  return munmap(reinterpret_cast<void *>(fn_addr), fn_len);
+}
+
+/*
+ * Dispatch a fastcall to the emulated function.
+ *
+ * Never inlined, like the fccmp stand-ins, to keep the cost of a function
+ * call.
+ */
+NOINLINE long invoke(unsigned char number, unsigned long arg0 = 0,
+                     unsigned long arg1 = 0) {
+  if (number >= TABLE_SIZE)
+    return fail(EINVAL);
+
+  Slot &slot = table[number];
+  switch (slot.kind.load(std::memory_order_acquire)) {
+  case NOOP:
+    return 0;
+  case STACK:
+    return arg0;
+  case PRIV:
+    return arg0 + 1;
+  case ARRAY:
+    if (arg0 >= ARRAY_SIZE || arg1 > DATA_SIZE)
+      return fail(EINVAL);
+    std::memcpy(slot.array + arg0 * DATA_SIZE, slot.shared, arg1);
+    return 0;
+  case NT:
+    if (arg0 >= ARRAY_SIZE)
+      return fail(EINVAL);
+    emulation::copy_nt(slot.array + arg0 * DATA_SIZE, slot.shared, DATA_SIZE);
+    return 0;
+  default:
+    return fail(EINVAL);
+  }
+}
+
+} // namespace fce::emu
+
+#undef NOINLINE
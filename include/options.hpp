@@ -1,12 +1,14 @@
 /*
- * This files handles the parsing of program options for the misc and cycles
- * benchmarks.
+ * This files handles the parsing of program options for the misc, cycles and
+ * syscall benchmarks.
  */
 
 #pragma once
 
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <string>
+#include <vector>
 
 namespace options {
 
@@ -16,18 +18,69 @@ static const std::uint64_t DEFAULT_BENCH_ITERS = 1e4;
 struct Opt {
   std::uint64_t warmup_iters;
   std::uint64_t bench_iters;
-  std::string benchmark;
+  bool record;
+  bool summary;
+  std::string trace;
+  bool list;
+  /* Names or glob patterns of the benchmarks to run */
+  std::vector<std::string> benchmarks;
 };
 
+namespace po = boost::program_options;
+
 /*
- * Parses command line options and exits on failure.
+ * Add the options controlling how samples are written.
  */
-static inline Opt parse_cmd(int argc, char const *const argv[]) {
-  namespace po = boost::program_options;
+static inline void add_output_options(po::options_description &desc,
+                                      Opt &opt) {
+  desc.add_options()("trace,t", po::value<std::string>(&opt.trace),
+                     "write samples to a binary trace file");
+}
 
-  Opt opt;
+/*
+ * Print the usage information and exit.
+ */
+[[noreturn]] static inline void usage(char const *program,
+                                      po::options_description const &desc,
+                                      char const *synopsis) {
+  std::cerr << "Usage: " << program << synopsis << "\n\n";
+  std::cerr << desc << std::endl;
+  exit(1);
+}
+
+/*
+ * Parse the command line into vm and exit on failure.
+ */
+static inline void parse(int argc, char const *const argv[],
+                         po::options_description const &desc,
+                         po::positional_options_description const &pos,
+                         po::variables_map &vm, char const *synopsis) {
   bool error = false;
 
+  try {
+    auto parser =
+        po::command_line_parser(argc, argv).options(desc).positional(pos).run();
+    po::store(parser, vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << '\n';
+    error = true;
+  }
+
+  if (error || vm.count("help"))
+    usage(argv[0], desc, synopsis);
+}
+
+/*
+ * Parses command line options and exits on failure.
+ *
+ * Executable-specific options can be passed in extra.
+ */
+static inline Opt
+parse_cmd(int argc, char const *const argv[],
+          po::options_description const &extra = po::options_description{}) {
+  Opt opt;
+
   po::options_description desc("Options");
   desc.add_options()("help", "produce help message");
   desc.add_options()("warmup,w",
@@ -38,29 +91,58 @@ static inline Opt parse_cmd(int argc, char const *const argv[]) {
                      po::value<std::uint64_t>(&opt.bench_iters)
                          ->default_value(DEFAULT_BENCH_ITERS),
                      "benchmark iterations w/o warmup");
-  desc.add_options()("benchmark,b", po::value<std::string>(&opt.benchmark),
-                     "benchmark to run");
+  desc.add_options()("record,r", po::bool_switch(&opt.record),
+                     "keep samples in memory and print them after the run");
+  desc.add_options()("summary,s", po::bool_switch(&opt.summary),
+                     "only print distribution statistics after the run");
+  add_output_options(desc, opt);
+  desc.add_options()("list,l", po::bool_switch(&opt.list),
+                     "list the (matching) benchmarks and exit");
+  desc.add_options()(
+      "benchmark,b",
+      po::value<std::vector<std::string>>(&opt.benchmarks)->multitoken(),
+      "benchmarks to run, glob patterns are allowed");
+  desc.add(extra);
   po::positional_options_description pos;
-  pos.add("benchmark", 1);
+  pos.add("benchmark", -1);
 
+  static const char synopsis[] = " [options] <benchmark>...";
   po::variables_map vm;
-  try {
-    auto parser =
-        po::command_line_parser(argc, argv).options(desc).positional(pos).run();
-    po::store(parser, vm);
-    po::notify(vm);
-  } catch (po::error &e) {
-    std::cerr << e.what() << '\n';
-    error = true;
-  }
+  parse(argc, argv, desc, pos, vm, synopsis);
+  if (opt.list && opt.benchmarks.empty())
+    opt.benchmarks.push_back("*");
+  if (opt.benchmarks.empty())
+    usage(argv[0], desc, synopsis);
 
-  if (error || vm.count("help") || !vm.count("benchmark")) {
-    std::cerr << "Usage: " << argv[0] << " [options] <benchmark>\n\n";
-    std::cerr << desc << std::endl;
-    exit(1);
-  }
+  return opt;
+}
+
+/*
+ * Parses the command line options of the syscall benchmark and exits on
+ * failure.
+ *
+ * Architecture-specific options can be passed in extra.
+ */
+static inline Opt parse_syscall_cmd(
+    int argc, char const *const argv[], std::uint64_t default_iters,
+    po::options_description const &extra = po::options_description{}) {
+  Opt opt{};
+
+  po::options_description desc("Options");
+  desc.add_options()("help", "produce help message");
+  desc.add_options()(
+      "iter,i",
+      po::value<std::uint64_t>(&opt.bench_iters)->default_value(default_iters),
+      "benchmark iterations");
+  desc.add_options()("summary,s", po::bool_switch(&opt.summary),
+                     "only print per-stage statistics after the run");
+  add_output_options(desc, opt);
+  desc.add(extra);
+
+  po::variables_map vm;
+  parse(argc, argv, desc, {}, vm, " [options]");
 
   return opt;
 }
 
-} // namespace options
\ No newline at end of file
+} // namespace options
@@ -1,24 +1,37 @@
 /* Helper for OS-related functionality. */
 #pragma once
 
+#include <cctype>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sched.h>
 #include <string>
 #include <sys/utsname.h>
+#include <unistd.h>
+#include <vector>
 
 namespace os {
 
 static const std::string RELEASE_FCCMP{"5.11.0-fccmp"};
 static const std::string RELEASE_SYSCALL_BENCH{"5.11.0-syscall-bench"};
 
-/*
- * Exit program if not run under the right kernel.
- *
- * This should prevent executing novel, unintended system calls when
- * accidentally running under a newer/different kernel version.
- */
-static inline void assert_kernel(std::string const &expected) {
+/* Size of a cache line */
+static const std::size_t CACHE_LINE_SIZE = 64;
+/* Last-level cache size if it is unknown */
+static const std::size_t DEFAULT_LLC_SIZE = 64 << 20;
+
+/* Return the size of the last-level cache or a default. */
+static inline std::size_t llc_size() {
+  long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  return llc > 0 ? static_cast<std::size_t>(llc) : DEFAULT_LLC_SIZE;
+}
+
+/* Return the release of the running kernel and exit on failure. */
+static inline std::string kernel_release() {
   utsname buf{};
 
   if (uname(&buf)) {
@@ -26,13 +39,72 @@ static inline void assert_kernel(std::string const &expected) {
     exit(2);
   }
 
-  std::string release{buf.release};
+  return buf.release;
+}
+
+/*
+ * Exit program if not run under the right kernel.
+ *
+ * This should prevent executing novel, unintended system calls when
+ * accidentally running under a newer/different kernel version.
+ */
+static inline void assert_kernel(std::string const &expected) {
+  std::string release = kernel_release();
   if (release.rfind(expected, 0) != 0) {
     std::cerr << "not running under " << expected << " kernel" << std::endl;
     exit(2);
   }
 }
 
+/*
+ * Return the value of the first line in /proc/cpuinfo starting with key or an
+ * empty string.
+ */
+static inline std::string cpuinfo(std::string const &key) {
+  std::ifstream file{"/proc/cpuinfo"};
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.rfind(key, 0) != 0)
+      continue;
+
+    auto colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+
+    auto start = line.find_first_not_of(" \t", colon + 1);
+    return start == std::string::npos ? "" : line.substr(start);
+  }
+
+  return "";
+}
+
+/* Return a human-readable description of the CPU model. */
+static inline std::string cpu_model() {
+  std::string model = cpuinfo("model name");
+  if (!model.empty())
+    return model;
+
+  // arm64 only identifies the implementer and part number.
+  std::string implementer = cpuinfo("CPU implementer");
+  if (!implementer.empty())
+    return "implementer " + implementer + " part " + cpuinfo("CPU part");
+
+  return "unknown";
+}
+
+/*
+ * Restrict the calling thread to a single CPU.
+ *
+ * Returns false and sets errno on failure.
+ */
+static inline bool pin_cpu(unsigned int cpu) {
+  // Dynamic CPU masks are not needed for systems which have < 1024 cores.
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return !sched_setaffinity(0, sizeof(set), &set);
+}
+
 /* Set CPU affinity and return current CPU (if possible). */
 static inline unsigned int fix_cpu() {
   int cpu = sched_getcpu();
@@ -42,15 +114,65 @@ static inline unsigned int fix_cpu() {
     cpu = 0;
   }
 
-  // Dynamic CPU masks are not needed for systems which have < 1024 cores.
-  cpu_set_t set;
-  CPU_ZERO(&set);
-  CPU_SET(cpu, &set);
-  if (sched_setaffinity(0, sizeof(set), &set))
+  if (!pin_cpu(cpu))
     std::cerr << "cannot set CPU affinity, continuing anyway: "
               << std::strerror(errno) << std::endl;
 
   return cpu;
 }
 
+/* Return the CPUs the calling thread is allowed to run on. */
+static inline std::vector<unsigned int> allowed_cpus() {
+  std::vector<unsigned int> cpus;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    std::cerr << "cannot get CPU affinity: " << std::strerror(errno)
+              << std::endl;
+    return cpus;
+  }
+
+  for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (CPU_ISSET(cpu, &set))
+      cpus.push_back(cpu);
+  return cpus;
+}
+
+/*
+ * Parse a CPU list like 0-3,8 in the format used by sysfs.
+ *
+ * Parsing stops at the first malformed entry.
+ */
+static inline std::vector<unsigned int>
+parse_cpu_list(std::string const &list) {
+  std::vector<unsigned int> cpus;
+  char const *pos = list.c_str();
+  while (std::isdigit(static_cast<unsigned char>(*pos))) {
+    char *end;
+    unsigned long first = std::strtoul(pos, &end, 10), last = first;
+    if (*end == '-')
+      last = std::strtoul(end + 1, &end, 10);
+
+    for (unsigned long cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+    pos = *end == ',' ? end + 1 : end;
+  }
+  return cpus;
+}
+
+/* Return the other hardware threads of the core of cpu. */
+static inline std::vector<unsigned int> smt_siblings(unsigned int cpu) {
+  std::ifstream file{"/sys/devices/system/cpu/cpu" + std::to_string(cpu) +
+                     "/topology/thread_siblings_list"};
+  std::string list;
+  std::getline(file, list);
+
+  std::vector<unsigned int> siblings;
+  for (unsigned int sibling : parse_cpu_list(list))
+    if (sibling != cpu)
+      siblings.push_back(sibling);
+  return siblings;
+}
+
 } // namespace os
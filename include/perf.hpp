@@ -1,38 +1,214 @@
 /* Generic functionality for working with perf */
 #pragma once
 
+#include "compiler.hpp"
 #include "os.hpp"
 
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <iostream>
 #include <linux/perf_event.h>
+#include <optional>
 #include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <system_error>
 #include <unistd.h>
+#include <vector>
 
 namespace perf {
 
-/* Fix thread to a specific CPU and initialize perf for HW cycle counting. */
-static inline int initialize() {
-  unsigned int cpu = os::fix_cpu();
+/* Maximum number of events which are counted together. */
+static const std::size_t MAX_EVENTS = 8;
+
+/*
+ * Hardware event which can be counted, named like in perf-list(1).
+ */
+struct Event {
+  char const *name;
+  std::uint32_t type;
+  std::uint64_t config;
+};
+
+static constexpr std::uint64_t cache_event(perf_hw_cache_id cache,
+                                           perf_hw_cache_op_id op,
+                                           perf_hw_cache_op_result_id result) {
+  return cache | (op << 8) | (result << 16);
+}
+
+static const std::array<Event, 11> EVENTS{{
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"stalled-cycles-frontend", PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+    {"stalled-cycles-backend", PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"L1-dcache-load-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"L1-icache-load-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"LLC-load-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dTLB-load-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"dTLB-store-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_WRITE,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+    {"iTLB-load-misses", PERF_TYPE_HW_CACHE,
+     cache_event(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_OP_READ,
+                 PERF_COUNT_HW_CACHE_RESULT_MISS)},
+}};
+
+/*
+ * Software events which indicate that a measurement was disturbed.
+ */
+static const std::array<Event, 3> SOFTWARE_EVENTS{{
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+}};
+
+/*
+ * Model-specific event given by its raw configuration, e.g. received hardware
+ * interrupts.
+ */
+static constexpr Event raw_event(char const *name, std::uint64_t config) {
+  return {name, PERF_TYPE_RAW, config};
+}
+
+/*
+ * Look up an event by name.
+ */
+static inline Event const &find_event(std::string const &name) {
+  for (auto const &event : EVENTS)
+    if (name == event.name)
+      return event;
 
+  std::string msg{"unknown perf event " + name + " (supported:"};
+  for (auto const &event : EVENTS)
+    msg += std::string{" "} + event.name;
+  throw std::invalid_argument{msg + ")"};
+}
+
+/*
+ * Parse a comma-separated list of event names.
+ */
+static inline std::vector<Event> parse_events(std::string const &list) {
+  std::vector<Event> events;
+  std::istringstream stream{list};
+  std::string name;
+  while (std::getline(stream, name, ','))
+    events.push_back(find_event(name));
+
+  if (events.empty() || events.size() > MAX_EVENTS)
+    throw std::invalid_argument{"between 1 and " + std::to_string(MAX_EVENTS) +
+                                " perf events are required"};
+  return events;
+}
+
+/*
+ * Open a counter for event on cpu, optionally as member of a group.
+ *
+ * With cpu -1, the calling thread is followed on all CPUs. config1 holds
+ * PMU-specific flags, e.g. requesting user-space access on arm64.
+ */
+static inline int open_event(Event const &event, int cpu, int group_fd = -1,
+                             std::uint64_t config1 = 0) {
   perf_event_attr attr{};
-  attr.type = PERF_TYPE_HARDWARE;
+  attr.type = event.type;
   attr.size = sizeof(attr);
-  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.config = event.config;
+  attr.config1 = config1;
+  attr.read_format = PERF_FORMAT_GROUP;
   attr.exclude_hv = true;
-  attr.pinned = true;
+  // Only a group leader may be pinned.
+  attr.pinned = group_fd < 0;
 
-  int fd =
-      syscall(SYS_perf_event_open, &attr, 0, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+  int fd = syscall(SYS_perf_event_open, &attr, 0, cpu, group_fd,
+                   PERF_FLAG_FD_CLOEXEC);
   if (fd < 0)
-    throw std::system_error{errno, std::generic_category()};
+    throw std::system_error{errno, std::generic_category(),
+                            std::string{"cannot open perf event "} +
+                                event.name};
 
   return fd;
 }
 
+/*
+ * Fix thread to a specific CPU and initialize perf for counting event,
+ * by default HW cycles.
+ */
+static inline int initialize(Event const &event = EVENTS[0]) {
+  return open_event(event, os::fix_cpu());
+}
+
+/*
+ * Fix thread to a specific CPU and open the events as one group, which is
+ * scheduled onto the PMU as a whole.
+ *
+ * config1 optionally returns the PMU-specific flags of an event. Returns one
+ * file descriptor per event with the group leader first. If an event cannot
+ * be opened, the others are closed again.
+ */
+static inline std::vector<int>
+initialize(std::vector<Event> const &events,
+           std::uint64_t (*config1)(Event const &) = nullptr) {
+  unsigned int cpu = os::fix_cpu();
+
+  std::vector<int> fds;
+  try {
+    for (auto const &event : events)
+      fds.push_back(open_event(event, cpu, fds.empty() ? -1 : fds.front(),
+                               config1 ? config1(event) : 0));
+  } catch (...) {
+    for (int fd : fds)
+      close(fd);
+    throw;
+  }
+
+  return fds;
+}
+
+/*
+ * Open the events as one group following the calling thread on all CPUs.
+ */
+static inline int open_group(std::vector<Event> const &events) {
+  int leader = -1;
+  for (auto const &event : events) {
+    int fd = open_event(event, -1, leader);
+    if (leader < 0)
+      leader = fd;
+  }
+  return leader;
+}
+
+/*
+ * Read the values of all count events of the group led by fd.
+ */
+static inline void read_group(int fd, std::uint64_t *values,
+                              std::size_t count) {
+  // Layout for PERF_FORMAT_GROUP: number of events followed by the values
+  std::array<std::uint64_t, MAX_EVENTS + 1> buf;
+
+  std::size_t size = (count + 1) * sizeof(std::uint64_t);
+  auto ret = read(fd, buf.data(), size);
+  if (ret < 0)
+    throw std::system_error{errno, std::generic_category()};
+  else if (static_cast<std::size_t>(ret) != size || buf[0] != count)
+    throw std::runtime_error{"counter read returned with wrong size"};
+
+  std::copy(buf.begin() + 1, buf.begin() + 1 + count, values);
+}
+
 static inline perf_event_mmap_page *mmap(int fd) {
   perf_event_mmap_page *pc = reinterpret_cast<perf_event_mmap_page *>(
       ::mmap(nullptr, getpagesize(), PROT_READ, MAP_SHARED, fd, 0));
@@ -41,4 +217,50 @@ static inline perf_event_mmap_page *mmap(int fd) {
   return pc;
 }
 
+/*
+ * Conversion of clock ticks, e.g. of the TSC, to nanoseconds.
+ */
+struct TimeConversion {
+  std::uint32_t mult;
+  std::uint16_t shift;
+  /* Offset to perf time, cancels out for elapsed ticks */
+  std::uint64_t offset;
+
+  /*
+   * Convert elapsed ticks as described in perf_event_open(2), splitting the
+   * multiplication to avoid overflows.
+   */
+  std::uint64_t elapsed(std::uint64_t ticks) const {
+    std::uint64_t quot = ticks >> shift;
+    std::uint64_t rem = ticks & ((std::uint64_t{1} << shift) - 1);
+    return quot * mult + ((rem * mult) >> shift);
+  }
+
+  /* Convert an absolute tick count to perf time. */
+  std::uint64_t time(std::uint64_t ticks) const {
+    return offset + elapsed(ticks);
+  }
+};
+
+/*
+ * Read the TSC conversion of a perf page, if the kernel provides it.
+ */
+static inline std::optional<TimeConversion>
+time_conversion(perf_event_mmap_page const *pc) {
+  std::uint32_t seq;
+  TimeConversion conversion;
+  bool available;
+  do {
+    seq = compiler::read_once(pc->lock);
+    compiler::barrier();
+    available = pc->cap_user_time;
+    conversion = {pc->time_mult, pc->time_shift, pc->time_offset};
+    compiler::barrier();
+  } while (seq != compiler::read_once(pc->lock));
+
+  if (!available)
+    return std::nullopt;
+  return conversion;
+}
+
 } // namespace perf
@@ -0,0 +1,169 @@
+/*
+ * Self-registering benchmarks of the misc and cycles executables.
+ *
+ * Benchmarks register themselves with a static Registrar next to their
+ * definition. One invocation can then select several of them by name or glob
+ * pattern and run them under the same process state.
+ */
+#pragma once
+
+#include <fnmatch.h>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace registry {
+
+enum class Kind {
+  /* One sample column set per iteration */
+  SAMPLES,
+  /* Samples keyed by the sweep point in the first column */
+  KEYED,
+  /* Runs without controller and prints its own results */
+  STANDALONE,
+};
+
+/*
+ * Registered benchmark.
+ *
+ * Controller drives the sample-based benchmarks and Params holds the
+ * executable-specific options passed to every benchmark.
+ */
+template <class Controller, class Params> struct Benchmark {
+  std::string name;
+  Kind kind;
+  /* Set unless kind is STANDALONE */
+  std::function<int(Controller &, Params const &)> samples;
+  /* Set if kind is STANDALONE */
+  std::function<int(Params const &)> standalone;
+};
+
+/*
+ * All benchmarks of an executable in registration order.
+ */
+template <class Controller, class Params>
+static inline std::vector<Benchmark<Controller, Params>> &benchmarks() {
+  static std::vector<Benchmark<Controller, Params>> list;
+  return list;
+}
+
+/*
+ * Call fn and map a void result to success.
+ */
+template <class Fn, class... Args>
+static inline int call(Fn const &fn, Args &...args) {
+  if constexpr (std::is_void_v<std::invoke_result_t<Fn, Args &...>>) {
+    fn(args...);
+    return 0;
+  } else {
+    return fn(args...);
+  }
+}
+
+/*
+ * Registers a benchmark during static initialization.
+ *
+ * fn is invoked with (Params const &) for standalone benchmarks, otherwise
+ * with (Controller &, Params const &) or just (Controller &). It returns
+ * either void or an exit code.
+ */
+template <class Controller, class Params> class Registrar {
+public:
+  template <class Fn> Registrar(char const *name, Kind kind, Fn fn) {
+    Benchmark<Controller, Params> benchmark{name, kind, {}, {}};
+
+    if constexpr (std::is_invocable_v<Fn, Params const &>) {
+      benchmark.standalone = [fn](Params const &params) {
+        return call(fn, params);
+      };
+    } else if constexpr (std::is_invocable_v<Fn, Controller &,
+                                             Params const &>) {
+      benchmark.samples = [fn](Controller &controller, Params const &params) {
+        return call(fn, controller, params);
+      };
+    } else {
+      benchmark.samples = [fn](Controller &controller, Params const &) {
+        return call(fn, controller);
+      };
+    }
+
+    benchmarks<Controller, Params>().push_back(std::move(benchmark));
+  }
+};
+
+/*
+ * Select the benchmarks matching the glob patterns.
+ *
+ * Benchmarks are returned in the order of the patterns and at most once.
+ * Throws std::invalid_argument if a pattern does not match.
+ */
+template <class Controller, class Params>
+static inline std::vector<Benchmark<Controller, Params> const *>
+select(std::vector<std::string> const &patterns) {
+  std::vector<Benchmark<Controller, Params> const *> selected;
+
+  for (auto const &pattern : patterns) {
+    bool matched = false;
+    for (auto const &benchmark : benchmarks<Controller, Params>()) {
+      if (fnmatch(pattern.c_str(), benchmark.name.c_str(), 0))
+        continue;
+
+      matched = true;
+      bool duplicate = false;
+      for (auto other : selected)
+        duplicate |= other == &benchmark;
+      if (!duplicate)
+        selected.push_back(&benchmark);
+    }
+
+    if (!matched)
+      throw std::invalid_argument{"unknown benchmark " + pattern};
+  }
+
+  return selected;
+}
+
+/*
+ * Print the names of the benchmarks, one per line.
+ */
+template <class Controller, class Params>
+static inline void
+list(std::ostream &out,
+     std::vector<Benchmark<Controller, Params> const *> const &selected) {
+  for (auto benchmark : selected)
+    out << benchmark->name << '\n';
+}
+
+/*
+ * Trace file of one benchmark when several benchmarks are run.
+ *
+ * The benchmark name is inserted before the extension of path, if any.
+ */
+static inline std::string trace_path(std::string const &path,
+                                     std::string const &name, bool multiple) {
+  if (!multiple || path.empty())
+    return path;
+
+  auto slash = path.rfind('/');
+  auto dot = path.rfind('.');
+  if (dot == std::string::npos || dot == 0 ||
+      (slash != std::string::npos && dot < slash + 2))
+    return path + '.' + name;
+
+  return path.substr(0, dot) + '.' + name + path.substr(dot);
+}
+
+/*
+ * Separate the output of several benchmarks by a comment line.
+ *
+ * The line is flushed, so forked children cannot write it again.
+ */
+static inline void print_tag(std::ostream &out, std::string const &name) {
+  out << "# benchmark " << name << '\n';
+  out.flush();
+}
+
+} // namespace registry
@@ -0,0 +1,220 @@
+/* Buffering and output of benchmark samples. */
+#pragma once
+
+#include "stats.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <vector>
+
+namespace samples {
+
+/*
+ * Fixed-capacity sample buffer backed by prefaulted and locked memory.
+ *
+ * Storing a sample only writes to memory which is already mapped, so neither
+ * page faults nor system calls happen between the measured sections.
+ * Samples exceeding the capacity are dropped.
+ */
+class Buffer {
+public:
+  explicit Buffer(std::size_t capacity)
+      : capacity{capacity},
+        bytes{std::max<std::size_t>(capacity, 1) * sizeof(std::uint64_t)} {
+    void *ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ptr == MAP_FAILED)
+      throw std::system_error{errno, std::generic_category()};
+    data = static_cast<std::uint64_t *>(ptr);
+
+    if (mlock(data, bytes))
+      std::cerr << "cannot lock sample buffer, continuing anyway: "
+                << std::strerror(errno) << std::endl;
+  }
+  ~Buffer() {
+    if (munmap(data, bytes))
+      std::cerr << "failed to unmap sample buffer: " << std::strerror(errno)
+                << '\n';
+  }
+  Buffer(Buffer const &) = delete;
+  Buffer &operator=(Buffer const &) = delete;
+
+  /*
+   * Append a sample to the buffer.
+   */
+  inline __attribute__((always_inline)) void push(std::uint64_t sample) {
+    if (length < capacity)
+      data[length++] = sample;
+  }
+
+  std::uint64_t const *begin() const { return data; }
+  std::uint64_t const *end() const { return data + length; }
+  std::size_t size() const { return length; }
+  void clear() { length = 0; }
+
+private:
+  std::uint64_t *data;
+  std::size_t length = 0;
+  std::size_t capacity, bytes;
+};
+
+/*
+ * Selection of how samples are written.
+ */
+struct Config {
+  /* Defer writing samples until the end of the run. */
+  bool record;
+  /* Only print a distribution summary instead of the samples. */
+  bool summary;
+  /* Path of a binary trace or empty for text output. */
+  std::string trace;
+};
+
+/*
+ * Destination of the samples of a benchmark run.
+ *
+ * A sample is a row with one value per column. Rows are either printed as
+ * comma-separated text or written to a binary trace. In recording mode, they
+ * are stored in a Buffer first and only written out by finish().
+ * In summary mode, only a streaming summary of each column is kept and
+ * printed by finish(), unless a trace is written as well.
+ *
+ * If keyed, the first column holds a benchmark parameter, e.g., in a sweep.
+ * Summaries are then kept separately for every value of this key.
+ *
+ * After collect() was called, only the values of one column are kept in
+ * memory for further analysis and nothing is written.
+ */
+class Output {
+public:
+  Output(trace::Header const &header, std::uint64_t rows,
+         Config const &config, bool keyed = false)
+      : names{header.columns}, columns{header.columns.size()}, keyed{keyed},
+        print{config.trace.empty() && !config.summary},
+        summary{config.summary} {
+    if (config.record && (print || !config.trace.empty()))
+      buffer.emplace(rows * columns);
+    if (!config.trace.empty())
+      writer.emplace(config.trace, header, rows);
+  }
+
+  /*
+   * Add a row with one value per column.
+   */
+  inline __attribute__((always_inline)) void add(std::uint64_t const *row) {
+    if (collecting) {
+      collected.push_back(row[collect_column]);
+      return;
+    }
+
+    if (summary) {
+      auto &columns_summaries = summaries_for(keyed ? row[0] : 0);
+      for (std::size_t i = keyed; i < columns; i++)
+        columns_summaries[i - keyed].add(row[i]);
+    }
+
+    if (buffer) {
+      for (std::size_t i = 0; i < columns; i++)
+        buffer->push(row[i]);
+    } else
+      emit(row);
+  }
+
+  /*
+   * Keep the values of column instead of writing the samples.
+   */
+  void collect(std::size_t column, std::uint64_t rows) {
+    collecting = true;
+    collect_column = column;
+    collected.reserve(rows);
+  }
+
+  /*
+   * Values of the collected column.
+   */
+  std::vector<std::uint64_t> &get_collected() { return collected; }
+
+  /*
+   * Write out the recorded rows and finish the trace.
+   */
+  void finish() {
+    if (buffer) {
+      for (auto row = buffer->begin(); row < buffer->end(); row += columns)
+        emit(row);
+      buffer->clear();
+    }
+
+    if (writer)
+      writer->close();
+
+    if (summary) {
+      if (keyed)
+        std::cout << names[0] << ',';
+      stats::print_header(std::cout);
+      for (auto const &[key, column_summaries] : summaries) {
+        for (std::size_t i = keyed; i < columns; i++) {
+          if (keyed)
+            std::cout << key << ',';
+          stats::print(std::cout, names[i], column_summaries[i - keyed]);
+        }
+      }
+      summaries.clear();
+      current = nullptr;
+    }
+    std::cout.flush();
+  }
+
+private:
+  std::vector<std::string> names;
+  std::size_t columns;
+  bool keyed, print, summary;
+  std::map<std::uint64_t, std::vector<stats::Summary>> summaries;
+  std::uint64_t current_key = 0;
+  std::vector<stats::Summary> *current = nullptr;
+  std::optional<Buffer> buffer;
+  std::optional<trace::Writer> writer;
+  bool collecting = false;
+  std::size_t collect_column = 0;
+  std::vector<std::uint64_t> collected;
+
+  /* Look up the summaries for a key, which rarely changes. */
+  std::vector<stats::Summary> &summaries_for(std::uint64_t key) {
+    if (!current || key != current_key) {
+      current = &summaries[key];
+      current->resize(columns - keyed);
+      current_key = key;
+    }
+    return *current;
+  }
+
+  void emit(std::uint64_t const *row) {
+    if (writer) {
+      writer->write(row);
+      return;
+    }
+    if (!print)
+      return;
+
+    for (std::size_t i = 0; i < columns; i++) {
+      if (i)
+        std::cout << ',';
+      std::cout << row[i];
+    }
+
+    // Flush immediately unless output is deferred anyway.
+    if (buffer)
+      std::cout << '\n';
+    else
+      std::cout << std::endl;
+  }
+};
+
+} // namespace samples
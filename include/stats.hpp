@@ -0,0 +1,269 @@
+/*
+ * Streaming statistics over benchmark samples in constant memory.
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace stats {
+
+/*
+ * Log-linear histogram in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BITS are counted exactly. Above, every power of two is
+ * split into 2^(SUB_BITS - 1) equally sized buckets, which bounds the
+ * relative error of a reported value to 2^-(SUB_BITS - 1). Including the
+ * exact values, this takes 64 - SUB_BITS + 2 groups of buckets.
+ */
+class Histogram {
+public:
+  static constexpr unsigned SUB_BITS = 7;
+  static constexpr std::size_t SUB_COUNT = 1 << SUB_BITS;
+  static constexpr std::size_t HALF_COUNT = SUB_COUNT / 2;
+  static constexpr std::size_t BUCKETS = (64 - SUB_BITS + 2) * HALF_COUNT;
+
+  void add(std::uint64_t value) {
+    counts[index(value)]++;
+    total++;
+    lowest = std::min(lowest, value);
+    highest = std::max(highest, value);
+  }
+
+  std::uint64_t count() const { return total; }
+  std::uint64_t min() const { return total ? lowest : 0; }
+  std::uint64_t max() const { return highest; }
+
+  /*
+   * Return the value below or at which the given percentage of samples lie.
+   */
+  std::uint64_t percentile(double percent) const {
+    if (!total)
+      return 0;
+
+    auto rank = static_cast<std::uint64_t>(
+        std::ceil(percent / 100 * static_cast<double>(total)));
+    rank = std::clamp<std::uint64_t>(rank, 1, total);
+    // The extremes are known exactly.
+    if (rank == total)
+      return max();
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::clamp(representative(i), min(), max());
+    }
+    return max();
+  }
+
+  /*
+   * Add all samples of another histogram.
+   */
+  void merge(Histogram const &other) {
+    for (std::size_t i = 0; i < BUCKETS; i++)
+      counts[i] += other.counts[i];
+    total += other.total;
+    lowest = std::min(lowest, other.lowest);
+    highest = std::max(highest, other.highest);
+  }
+
+private:
+  std::array<std::uint64_t, BUCKETS> counts{};
+  std::uint64_t total = 0;
+  std::uint64_t lowest = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t highest = 0;
+
+  static std::size_t index(std::uint64_t value) {
+    if (value < SUB_COUNT)
+      return value;
+
+    unsigned msb = 63 - __builtin_clzll(value);
+    unsigned shift = msb - SUB_BITS + 1;
+    return shift * HALF_COUNT + (value >> shift);
+  }
+
+  /* Middle of the value range covered by a bucket. */
+  static std::uint64_t representative(std::size_t idx) {
+    if (idx < SUB_COUNT)
+      return idx;
+
+    unsigned shift = idx / HALF_COUNT - 1;
+    std::uint64_t lower = static_cast<std::uint64_t>(idx - shift * HALF_COUNT)
+                          << shift;
+    return lower + ((std::uint64_t{1} << shift) >> 1);
+  }
+};
+
+/*
+ * Welford's online algorithm for mean and variance.
+ */
+class Moments {
+public:
+  void add(double value) {
+    n++;
+    double delta = value - m;
+    m += delta / n;
+    m2 += delta * (value - m);
+  }
+
+  /*
+   * Combine with the moments of another sample set (Chan et al.).
+   */
+  void merge(Moments const &other) {
+    if (!other.n)
+      return;
+
+    std::uint64_t total = n + other.n;
+    double delta = other.m - m;
+    m += delta * other.n / total;
+    m2 += other.m2 + delta * delta * n * other.n / total;
+    n = total;
+  }
+
+  std::uint64_t count() const { return n; }
+  double mean() const { return m; }
+  double variance() const { return n > 1 ? m2 / (n - 1) : 0; }
+  double stddev() const { return std::sqrt(variance()); }
+
+private:
+  std::uint64_t n = 0;
+  double m = 0, m2 = 0;
+};
+
+/*
+ * Distribution summary of one sample column.
+ */
+class Summary {
+public:
+  void add(std::uint64_t value) {
+    hist.add(value);
+    moments.add(static_cast<double>(value));
+  }
+
+  void merge(Summary const &other) {
+    hist.merge(other.hist);
+    moments.merge(other.moments);
+  }
+
+  Histogram const &histogram() const { return hist; }
+  Moments const &get_moments() const { return moments; }
+
+private:
+  Histogram hist;
+  Moments moments;
+};
+
+/* Percentiles reported in addition to minimum and maximum. */
+static const std::array<std::pair<char const *, double>, 5> PERCENTILES{{
+    {"median", 50},
+    {"p90", 90},
+    {"p99", 99},
+    {"p99.9", 99.9},
+    {"p99.99", 99.99},
+}};
+
+/*
+ * Print the table header for summaries.
+ */
+static inline void print_header(std::ostream &out) {
+  out << "column,count,min";
+  for (auto const &percentile : PERCENTILES)
+    out << ',' << percentile.first;
+  out << ",max,mean,stddev\n";
+}
+
+/*
+ * Print a summary as a row of the table.
+ */
+static inline void print(std::ostream &out, std::string const &column,
+                         Summary const &summary) {
+  auto const &hist = summary.histogram();
+  out << column << ',' << hist.count() << ',' << hist.min();
+  for (auto const &percentile : PERCENTILES)
+    out << ',' << hist.percentile(percentile.second);
+  out << ',' << hist.max() << ',' << summary.get_moments().mean() << ','
+      << summary.get_moments().stddev() << '\n';
+}
+
+/*
+ * Exact percentile of a sample set by the nearest-rank method.
+ *
+ * The values are partially reordered.
+ */
+static inline std::uint64_t percentile(std::vector<std::uint64_t> &values,
+                                       double percent) {
+  if (values.empty())
+    return 0;
+
+  auto rank = static_cast<std::size_t>(
+      std::ceil(percent / 100 * static_cast<double>(values.size())));
+  rank = std::clamp<std::size_t>(rank, 1, values.size());
+
+  auto nth = values.begin() + (rank - 1);
+  std::nth_element(values.begin(), nth, values.end());
+  return *nth;
+}
+
+/*
+ * Point estimate of a statistic with its confidence interval.
+ */
+struct Interval {
+  double estimate, low, high;
+};
+
+/*
+ * Percentile bootstrap of several statistics over several sample sets.
+ *
+ * statistics maps the sample sets to a vector of statistics. In every
+ * replicate, all sets are resampled with replacement, so statistics combining
+ * several sets, e.g. ratios, get consistent intervals.
+ */
+template <class Statistics>
+static std::vector<Interval>
+bootstrap(std::vector<std::vector<std::uint64_t>> const &sets,
+          Statistics const &statistics, unsigned resamples, double confidence,
+          std::uint64_t seed = 0) {
+  auto copy = sets;
+  std::vector<double> estimates = statistics(copy);
+  std::vector<std::vector<double>> replicates(estimates.size());
+
+  std::mt19937_64 rng{seed};
+  for (unsigned r = 0; r < resamples; r++) {
+    for (std::size_t i = 0; i < sets.size(); i++) {
+      if (sets[i].empty())
+        continue;
+      std::uniform_int_distribution<std::size_t> pick{0, sets[i].size() - 1};
+      for (auto &value : copy[i])
+        value = sets[i][pick(rng)];
+    }
+
+    auto values = statistics(copy);
+    for (std::size_t i = 0; i < values.size(); i++)
+      replicates[i].push_back(values[i]);
+  }
+
+  std::vector<Interval> intervals;
+  double alpha = (1 - confidence) / 2;
+  for (std::size_t i = 0; i < estimates.size(); i++) {
+    auto &values = replicates[i];
+    std::sort(values.begin(), values.end());
+    auto at = [&](double q) {
+      if (values.empty())
+        return estimates[i];
+      auto idx = static_cast<std::size_t>(q * (values.size() - 1) + 0.5);
+      return values[idx];
+    };
+    intervals.push_back({estimates[i], at(alpha), at(1 - alpha)});
+  }
+  return intervals;
+}
+
+} // namespace stats
@@ -0,0 +1,331 @@
+/*
+ * Compact binary trace format for benchmark samples.
+ *
+ * A trace starts with a fixed header followed by length-prefixed strings
+ * (benchmark name, CPU model, kernel release, the number of environment
+ * entries and a key and value per entry, and one name per column).
+ * Afterwards, the samples follow as rows with a fixed number of columns.
+ * Every value is stored as the zigzag- and varint-encoded difference to the
+ * value of the same column in the previous row.
+ *
+ * All fixed-size fields use the byte order of the recording host.
+ * Version 1 traces lack the environment entries.
+ */
+#pragma once
+
+#include "env.hpp"
+#include "os.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace trace {
+
+static const char MAGIC[8] = {'F', 'C', 'T', 'R', 'A', 'C', 'E', '\0'};
+static const std::uint32_t VERSION = 2;
+/* First version with the environment entries */
+static const std::uint32_t VERSION_ENVIRONMENT = 2;
+
+/* Maximum length of a 64-bit varint. */
+static const std::size_t MAX_VARINT = 10;
+/* Initial size of the output file. */
+static const std::size_t INITIAL_SIZE = 1 << 20;
+
+struct FixedHeader {
+  char magic[sizeof(MAGIC)];
+  std::uint32_t version;
+  std::uint32_t columns;
+  std::uint64_t rows;
+  /* Width of the hardware counter in bits or 0 for other time sources. */
+  std::uint8_t counter_width;
+  std::uint8_t reserved[7];
+};
+
+/*
+ * Metadata describing the samples of a trace.
+ */
+struct Header {
+  std::string benchmark;
+  std::string cpu;
+  std::string kernel;
+  std::uint8_t counter_width;
+  std::vector<std::string> columns;
+  /* Environment fingerprint, see env::fingerprint() */
+  env::Fingerprint environment;
+};
+
+/*
+ * Create a header for the running system.
+ */
+static inline Header make_header(std::string const &benchmark,
+                                 std::uint8_t counter_width,
+                                 std::vector<std::string> const &columns) {
+  return Header{benchmark, os::cpu_model(), os::kernel_release(),
+                counter_width, columns, env::fingerprint()};
+}
+
+static inline std::uint64_t zigzag(std::int64_t value) {
+  return (static_cast<std::uint64_t>(value) << 1) ^
+         static_cast<std::uint64_t>(value >> 63);
+}
+
+static inline std::int64_t unzigzag(std::uint64_t value) {
+  return static_cast<std::int64_t>(value >> 1) ^
+         -static_cast<std::int64_t>(value & 1);
+}
+
+static inline unsigned char *put_varint(unsigned char *ptr,
+                                        std::uint64_t value) {
+  while (value >= 0x80) {
+    *ptr++ = static_cast<unsigned char>(value) | 0x80;
+    value >>= 7;
+  }
+  *ptr++ = static_cast<unsigned char>(value);
+  return ptr;
+}
+
+/*
+ * Writer which encodes rows into a memory-mapped output file.
+ *
+ * The file is preallocated for the expected number of rows in the worst
+ * case, so it only grows by doubling its size if more rows are written.
+ * On close, it is truncated to the written length and the row count in the
+ * header is updated.
+ */
+class Writer {
+public:
+  Writer(std::string const &path, Header const &header,
+         std::uint64_t expected_rows = 0)
+      : previous(header.columns.size(), 0) {
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw std::system_error{errno, std::generic_category(), path};
+
+    std::size_t needed = sizeof(FixedHeader);
+    for (auto const *str : {&header.benchmark, &header.cpu, &header.kernel})
+      needed += MAX_VARINT + str->size();
+    needed += MAX_VARINT;
+    for (auto const &[key, value] : header.environment)
+      needed += 2 * MAX_VARINT + key.size() + value.size();
+    for (auto const &column : header.columns)
+      needed += MAX_VARINT + column.size();
+    needed += expected_rows * previous.size() * MAX_VARINT;
+    grow(std::max(needed, INITIAL_SIZE));
+
+    FixedHeader fixed{};
+    std::memcpy(fixed.magic, MAGIC, sizeof(MAGIC));
+    fixed.version = VERSION;
+    fixed.columns = header.columns.size();
+    fixed.counter_width = header.counter_width;
+    std::memcpy(base, &fixed, sizeof(fixed));
+    length = sizeof(fixed);
+
+    put_string(header.benchmark);
+    put_string(header.cpu);
+    put_string(header.kernel);
+    length = put_varint(base + length, header.environment.size()) - base;
+    for (auto const &[key, value] : header.environment) {
+      put_string(key);
+      put_string(value);
+    }
+    for (auto const &column : header.columns)
+      put_string(column);
+  }
+  ~Writer() {
+    try {
+      close();
+    } catch (std::system_error const &e) {
+      std::cerr << "failed to finish trace: " << e.what() << '\n';
+    }
+  }
+  Writer(Writer const &) = delete;
+  Writer &operator=(Writer const &) = delete;
+
+  /*
+   * Append a row with one value per column.
+   */
+  void write(std::uint64_t const *row) {
+    if (size - length < previous.size() * MAX_VARINT)
+      grow(size * 2);
+
+    unsigned char *ptr = base + length;
+    for (std::size_t i = 0; i < previous.size(); i++) {
+      ptr = put_varint(ptr, zigzag(row[i] - previous[i]));
+      previous[i] = row[i];
+    }
+    length = ptr - base;
+    rows++;
+  }
+
+  /*
+   * Finish the trace and release the file.
+   */
+  void close() {
+    if (fd < 0)
+      return;
+
+    reinterpret_cast<FixedHeader *>(base)->rows = rows;
+    if (munmap(base, size))
+      throw std::system_error{errno, std::generic_category()};
+    if (ftruncate(fd, length))
+      throw std::system_error{errno, std::generic_category()};
+    if (::close(fd))
+      throw std::system_error{errno, std::generic_category()};
+    fd = -1;
+  }
+
+private:
+  int fd;
+  unsigned char *base = nullptr;
+  std::size_t size = 0, length = 0;
+  std::uint64_t rows = 0;
+  std::vector<std::uint64_t> previous;
+
+  void grow(std::size_t new_size) {
+    if (ftruncate(fd, new_size))
+      throw std::system_error{errno, std::generic_category()};
+
+    void *ptr;
+    if (base)
+      ptr = mremap(base, size, new_size, MREMAP_MAYMOVE);
+    else
+      ptr = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+      throw std::system_error{errno, std::generic_category()};
+
+    base = static_cast<unsigned char *>(ptr);
+    size = new_size;
+  }
+
+  void put_string(std::string const &str) {
+    unsigned char *ptr = put_varint(base + length, str.size());
+    std::memcpy(ptr, str.data(), str.size());
+    length = ptr + str.size() - base;
+  }
+};
+
+/*
+ * Reader which decodes a trace from a memory-mapped file.
+ */
+class Reader {
+public:
+  explicit Reader(std::string const &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw std::system_error{errno, std::generic_category(), path};
+
+    struct stat st;
+    if (fstat(fd, &st)) {
+      int err = errno;
+      ::close(fd);
+      throw std::system_error{err, std::generic_category(), path};
+    }
+    size = st.st_size;
+
+    void *ptr = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                     : MAP_FAILED;
+    int err = errno;
+    ::close(fd);
+    if (!size)
+      throw std::runtime_error{path + ": empty trace"};
+    if (ptr == MAP_FAILED)
+      throw std::system_error{err, std::generic_category(), path};
+    base = static_cast<unsigned char const *>(ptr);
+    madvise(ptr, size, MADV_SEQUENTIAL);
+
+    FixedHeader fixed;
+    if (size < sizeof(fixed))
+      throw std::runtime_error{path + ": truncated trace header"};
+    std::memcpy(&fixed, base, sizeof(fixed));
+    if (std::memcmp(fixed.magic, MAGIC, sizeof(MAGIC)))
+      throw std::runtime_error{path + ": not a fastcall trace"};
+    if (fixed.version < 1 || fixed.version > VERSION)
+      throw std::runtime_error{path + ": unsupported trace version " +
+                               std::to_string(fixed.version)};
+
+    position = sizeof(fixed);
+    rows = fixed.rows;
+    header.counter_width = fixed.counter_width;
+    header.benchmark = get_string();
+    header.cpu = get_string();
+    header.kernel = get_string();
+    if (fixed.version >= VERSION_ENVIRONMENT) {
+      std::uint64_t entries = get_varint();
+      for (std::uint64_t i = 0; i < entries; i++) {
+        std::string key = get_string();
+        header.environment.emplace_back(key, get_string());
+      }
+    }
+    for (std::uint32_t i = 0; i < fixed.columns; i++)
+      header.columns.push_back(get_string());
+    current.assign(fixed.columns, 0);
+    // Rows without columns still need a non-null pointer.
+    current.reserve(1);
+
+    // The writer only records the rows when it finishes the trace.
+    if (!rows && position < size)
+      throw std::runtime_error{path + ": unfinished trace"};
+  }
+  ~Reader() { munmap(const_cast<unsigned char *>(base), size); }
+  Reader(Reader const &) = delete;
+  Reader &operator=(Reader const &) = delete;
+
+  Header const &get_header() const { return header; }
+
+  /* Number of rows as recorded in the header. */
+  std::uint64_t get_rows() const { return rows; }
+
+  /*
+   * Decode the next row and return nullptr after the recorded rows.
+   */
+  std::uint64_t const *next() {
+    if (decoded == rows)
+      return nullptr;
+    decoded++;
+
+    for (auto &value : current)
+      value += unzigzag(get_varint());
+    return current.data();
+  }
+
+private:
+  unsigned char const *base;
+  std::size_t size, position;
+  std::uint64_t rows, decoded = 0;
+  Header header;
+  std::vector<std::uint64_t> current;
+
+  std::uint64_t get_varint() {
+    std::uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (position >= size)
+        throw std::runtime_error{"truncated trace"};
+      unsigned char byte = base[position++];
+      value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    throw std::runtime_error{"malformed varint in trace"};
+  }
+
+  std::string get_string() {
+    std::uint64_t length = get_varint();
+    if (length > size - position)
+      throw std::runtime_error{"truncated trace"};
+    std::string str{reinterpret_cast<char const *>(base + position), length};
+    position += length;
+    return str;
+  }
+};
+
+} // namespace trace
@@ -0,0 +1,151 @@
+/*
+ * Typed table of the vDSO functions of fccmp and of the standard vDSO
+ * functions.
+ *
+ * All symbols are resolved once on first use, so benchmarks do not parse the
+ * vDSO again for every lookup. Functions the vDSO does not provide are
+ * nullptr.
+ */
+#pragma once
+
+#include "fccmp.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <sys/auxv.h>
+#include <sys/time.h>
+#include <utility>
+
+extern "C" void vdso_init_from_sysinfo_ehdr(uintptr_t base);
+extern "C" void *vdso_sym(const char *version, const char *name);
+
+namespace vdso {
+
+#ifdef __aarch64__
+static const char VERSION[] = "LINUX_2.6.39";
+
+static const char CLOCK_GETTIME_NAME[] = "__kernel_clock_gettime";
+static const char CLOCK_GETRES_NAME[] = "__kernel_clock_getres";
+static const char GETTIMEOFDAY_NAME[] = "__kernel_gettimeofday";
+/* Not provided on arm64 */
+static const char TIME_NAME[] = "__vdso_time";
+static const char GETCPU_NAME[] = "__vdso_getcpu";
+#else
+static const char VERSION[] = "LINUX_2.6";
+
+static const char CLOCK_GETTIME_NAME[] = "__vdso_clock_gettime";
+static const char CLOCK_GETRES_NAME[] = "__vdso_clock_getres";
+static const char GETTIMEOFDAY_NAME[] = "__vdso_gettimeofday";
+static const char TIME_NAME[] = "__vdso_time";
+static const char GETCPU_NAME[] = "__vdso_getcpu";
+#endif
+
+typedef int CLOCK_GETTIME_TYPE(clockid_t clock, timespec *ts);
+typedef int CLOCK_GETRES_TYPE(clockid_t clock, timespec *res);
+typedef int GETTIMEOFDAY_TYPE(timeval *tv, struct timezone *tz);
+typedef time_t TIME_TYPE(time_t *t);
+typedef long GETCPU_TYPE(unsigned *cpu, unsigned *node, void *cache);
+
+enum Function : std::size_t {
+  FCCMP_NOOP,
+  FCCMP_COPY_ARRAY,
+  FCCMP_COPY_NT,
+  CLOCK_GETTIME,
+  CLOCK_GETRES,
+  GETTIMEOFDAY,
+  TIME,
+  GETCPU,
+  /* Number of functions */
+  FUNCTIONS,
+};
+
+/*
+ * Symbol name and type of a function.
+ */
+template <Function function> struct Signature;
+
+#define VDSO_SIGNATURE(function, symbol, signature)                          \
+  template <> struct Signature<function> {                                   \
+    static constexpr const char *name = symbol;                              \
+    typedef signature type;                                                  \
+  };
+
+VDSO_SIGNATURE(FCCMP_NOOP, fccmp::VDSO_NOOP, fccmp::VDSO_NOOP_TYPE)
+VDSO_SIGNATURE(FCCMP_COPY_ARRAY, fccmp::VDSO_COPY_ARRAY,
+               fccmp::VDSO_COPY_ARRAY_TYPE)
+VDSO_SIGNATURE(FCCMP_COPY_NT, fccmp::VDSO_COPY_NT, fccmp::VDSO_COPY_NT_TYPE)
+VDSO_SIGNATURE(CLOCK_GETTIME, CLOCK_GETTIME_NAME, CLOCK_GETTIME_TYPE)
+VDSO_SIGNATURE(CLOCK_GETRES, CLOCK_GETRES_NAME, CLOCK_GETRES_TYPE)
+VDSO_SIGNATURE(GETTIMEOFDAY, GETTIMEOFDAY_NAME, GETTIMEOFDAY_TYPE)
+VDSO_SIGNATURE(TIME, TIME_NAME, TIME_TYPE)
+VDSO_SIGNATURE(GETCPU, GETCPU_NAME, GETCPU_TYPE)
+
+#undef VDSO_SIGNATURE
+
+template <std::size_t... functions>
+static constexpr std::array<const char *, FUNCTIONS>
+names(std::index_sequence<functions...>) {
+  return {Signature<static_cast<Function>(functions)>::name...};
+}
+
+/* Symbol names indexed by Function */
+static constexpr std::array<const char *, FUNCTIONS> NAMES =
+    names(std::make_index_sequence<FUNCTIONS>{});
+
+/*
+ * Return the function with the given symbol name or FUNCTIONS.
+ *
+ * Symbol names are compared by address, so name must be one of the name
+ * constants.
+ */
+static constexpr Function find(const char *name) {
+  for (std::size_t i = 0; i < FUNCTIONS; i++)
+    if (NAMES[i] == name)
+      return static_cast<Function>(i);
+  return FUNCTIONS;
+}
+
+/*
+ * Addresses of all functions, resolved on construction.
+ */
+class Table {
+public:
+  Table() {
+    if (auto base = getauxval(AT_SYSINFO_EHDR))
+      vdso_init_from_sysinfo_ehdr(base);
+
+    for (std::size_t i = 0; i < FUNCTIONS; i++)
+      functions[i] = resolve(NAMES[i]);
+  }
+
+  void *operator[](Function function) const { return functions[function]; }
+
+private:
+  std::array<void *, FUNCTIONS> functions;
+
+  static void *resolve(const char *name) {
+#ifdef FASTCALL_EMULATION
+    // Only the functions of fccmp are emulated.
+    if (void *function = fccmp::emu::vdso_sym(name))
+      return function;
+#endif
+    return vdso_sym(VERSION, name);
+  }
+};
+
+static inline Table const &table() {
+  static const Table table;
+  return table;
+}
+
+/*
+ * Return the function if the vDSO provides it, otherwise nullptr.
+ */
+template <Function function>
+static inline typename Signature<function>::type *get() {
+  return reinterpret_cast<typename Signature<function>::type *>(
+      table()[function]);
+}
+
+} // namespace vdso
@@ -0,0 +1,146 @@
+/*
+ * Concurrent fastcall registration and deregistration from multiple threads.
+ */
+#pragma once
+
+#include "fce.hpp"
+#include "os.hpp"
+#include "stats.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace churn {
+
+using std::chrono::steady_clock;
+namespace chrono = std::chrono;
+
+static const std::size_t CACHE_LINE = 64;
+
+struct Config {
+  /* Number of threads, 0 for all allowed CPUs */
+  unsigned int threads;
+  /* Measurement duration in seconds */
+  double duration;
+};
+
+/*
+ * Latencies measured by one thread, aligned to avoid false sharing.
+ */
+struct alignas(CACHE_LINE) Result {
+  stats::Summary registration, deregistration;
+  /* Message of a failed operation or empty */
+  std::string error;
+};
+
+static inline std::uint64_t nanos_since(steady_clock::time_point start) {
+  return chrono::duration_cast<chrono::nanoseconds>(steady_clock::now() -
+                                                    start)
+      .count();
+}
+
+/*
+ * Register and deregister fastcalls on cpu until stop is set.
+ */
+template <class Args>
+static void worker(unsigned int cpu, unsigned type, fce::FileDescriptor &fd,
+                   std::atomic<unsigned int> &ready,
+                   std::atomic<bool> const &go, std::atomic<bool> const &stop,
+                   Result &result) {
+  if (!os::pin_cpu(cpu))
+    std::cerr << "cannot pin thread to CPU " << cpu << ": "
+              << std::strerror(errno) << '\n';
+
+  ready.fetch_add(1);
+  while (!go.load(std::memory_order_acquire))
+    ;
+
+  try {
+    Args args;
+    while (!stop.load(std::memory_order_relaxed)) {
+      auto start = steady_clock::now();
+      fd.io(type, &args);
+      result.registration.add(nanos_since(start));
+
+      start = steady_clock::now();
+      fce::deregister(args);
+      result.deregistration.add(nanos_since(start));
+    }
+  } catch (std::exception const &e) {
+    result.error = e.what();
+  }
+}
+
+/*
+ * Let threads pinned to distinct CPUs register and deregister fastcalls
+ * concurrently.
+ *
+ * Prints the latency distributions over all threads and the aggregate
+ * throughput of (de)registration pairs. Fails if there are more threads than
+ * allowed CPUs.
+ */
+template <class Args> static int run(Config const &config, unsigned type) {
+  auto cpus = os::allowed_cpus();
+  if (cpus.empty()) {
+    std::cerr << "no CPUs available\n";
+    return 1;
+  }
+
+  unsigned int threads = config.threads ? config.threads : cpus.size();
+  if (threads > cpus.size()) {
+    std::cerr << threads << " threads need distinct CPUs, allowed CPUs: "
+              << cpus.size() << '\n';
+    return 1;
+  }
+
+  fce::FileDescriptor fd{};
+  std::unique_ptr<Result[]> results{new Result[threads]};
+  std::atomic<unsigned int> ready{0};
+  std::atomic<bool> go{false}, stop{false};
+
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < threads; i++)
+    workers.emplace_back(worker<Args>, cpus[i], type,
+                         std::ref(fd), std::ref(ready), std::cref(go),
+                         std::cref(stop), std::ref(results[i]));
+
+  while (ready.load() < threads)
+    std::this_thread::yield();
+  auto start = steady_clock::now();
+  go.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(chrono::duration<double>(config.duration));
+  stop.store(true, std::memory_order_relaxed);
+  chrono::duration<double> elapsed{steady_clock::now() - start};
+  for (auto &thread : workers)
+    thread.join();
+
+  int err = 0;
+  stats::Summary registration, deregistration;
+  for (unsigned int i = 0; i < threads; i++) {
+    if (!results[i].error.empty()) {
+      std::cerr << "thread " << i << ": " << results[i].error << '\n';
+      err = 1;
+    }
+    registration.merge(results[i].registration);
+    deregistration.merge(results[i].deregistration);
+  }
+
+  stats::print_header(std::cout);
+  stats::print(std::cout, "registration", registration);
+  stats::print(std::cout, "deregistration", deregistration);
+
+  auto pairs = deregistration.histogram().count();
+  std::cout << "threads,seconds,pairs,pairs_per_second\n"
+            << threads << ',' << elapsed.count() << ',' << pairs << ','
+            << pairs / elapsed.count() << std::endl;
+
+  return err;
+}
+
+} // namespace churn
@@ -3,6 +3,8 @@
  */
 #pragma once
 
+#include "samples.hpp"
+#include <array>
 #include <chrono>
 #include <iostream>
 #include <stdint.h>
@@ -17,17 +19,33 @@ namespace ctrl {
 /*
  * Controller which counts the performed iterations and prints the measured
  * times.
+ *
+ * The samples are passed to an output which might defer writing them until
+ * finish() is called.
+ *
+ * For a keyed output, every sample is preceded by the key of the current
+ * sweep point.
  */
 class Controller {
 public:
-  Controller(std::uint64_t warmup_iters, std::uint64_t bench_iters)
-      : iters{warmup_iters + bench_iters}, bench_iters{bench_iters} {}
+  Controller(std::uint64_t warmup_iters, std::uint64_t bench_iters,
+             samples::Output &output, bool keyed = false)
+      : iters{warmup_iters + bench_iters}, warmup_iters{warmup_iters},
+        bench_iters{bench_iters}, output{output}, keyed{keyed} {}
 
   /*
    * Returns true as long as the benchmarks should continue.
    */
   bool cont() { return iters-- > 0; }
 
+  /*
+   * Restart the iterations, including the warmup, for another sweep point.
+   */
+  void restart(std::uint64_t key) {
+    iters = warmup_iters + bench_iters;
+    row[0] = key;
+  }
+
   /*
    * Start a timed benchmark section.
    */
@@ -52,20 +70,31 @@ public:
   /*
    * End a timed benchmark section.
    *
-   * Prints the result if not still in the warmup phase.
+   * Prints or records the result if not still in the warmup phase.
    */
   void INLINE end_timer() {
     // prevent reordering of instructions after the end
     asm volatile("" : : : "memory");
     steady_clock::duration duration{steady_clock::now() - start};
     auto nanos = chrono::duration_cast<chrono::nanoseconds>(duration);
-    if (iters < bench_iters)
-      std::cout << nanos.count() << std::endl;
+    if (iters >= bench_iters)
+      return;
+
+    row[1] = nanos.count();
+    output.add(keyed ? row.data() : &row[1]);
   }
 
+  /*
+   * Write out the results after the benchmark finished.
+   */
+  void finish() { output.finish(); }
+
 private:
-  std::uint64_t iters, bench_iters;
+  std::uint64_t iters, warmup_iters, bench_iters;
   steady_clock::time_point start;
+  samples::Output &output;
+  bool keyed;
+  std::array<std::uint64_t, 2> row{};
 };
 
 } // namespace ctrl
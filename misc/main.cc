@@ -1,16 +1,72 @@
+#include "churn.hpp"
 #include "controller.hpp"
+#include "env.hpp"
 #include "fastcall.hpp"
 #include "fce.hpp"
 #include "options.hpp"
+#include "registry.hpp"
 #include <boost/program_options.hpp>
 #include <cerrno>
 #include <iostream>
 #include <string>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <vector>
 
 using namespace ctrl;
 
+/*
+ * Points of a sweep over the number of registered fastcalls.
+ */
+struct Sweep {
+  std::vector<std::uint64_t> counts;
+  fce::Fill fill;
+};
+
+/*
+ * Default sweep points up to the size of the fastcall table, leaving one slot
+ * for the fastcall registered by the (de)registration sweeps.
+ */
+static const std::vector<std::uint64_t> DEFAULT_SWEEP{
+    0, 1, 10, 100, 200, fce::TABLE_SIZE - 1};
+
+/*
+ * Options passed to every benchmark.
+ */
+struct Params {
+  Sweep sweep;
+  churn::Config churn;
+};
+
+using Registrar = registry::Registrar<Controller, Params>;
+using registry::Kind;
+
+/*
+ * Bring the number of registered fastcalls to count and, if probe is given,
+ * check that one more fastcall can be registered with it.
+ *
+ * Returns false if the kernel refuses the registrations.
+ */
+static bool prepare_sweep_point(fce::ManyFastcalls &fastcalls,
+                                std::uint64_t count,
+                                fce::FileDescriptor *probe = nullptr) {
+  try {
+    fastcalls.resize(count);
+
+    if (probe) {
+      fce::ioctl_args args;
+      probe->io(fce::IOCTL_NOOP, &args);
+      fce::deregister(args);
+    }
+  } catch (fce::Error &e) {
+    std::cerr << "stopping sweep at " << count
+              << " registered fastcalls: " << e.what() << '\n';
+    return false;
+  }
+
+  return true;
+}
+
 /*
  * Benchmark for just measuring the overhead of the timing functions.
  */
@@ -20,6 +76,7 @@ static void benchmark_noop(Controller &controller) {
     controller.end_timer();
   }
 }
+static Registrar noop_registrar{"noop", Kind::SAMPLES, benchmark_noop};
 
 /*
  * Benchmark of the fastcall registration process of a function without
@@ -39,6 +96,8 @@ static int benchmark_registration_minimal(Controller &controller) {
 
   return 0;
 }
+static Registrar registration_minimal_registrar{
+    "registration-minimal", Kind::SAMPLES, benchmark_registration_minimal};
 
 /*
  * Benchmark of the fastcall registration process of a function with
@@ -58,6 +117,37 @@ static int benchmark_registration_mappings(Controller &controller) {
 
   return 0;
 }
+static Registrar registration_mappings_registrar{
+    "registration-mappings", Kind::SAMPLES, benchmark_registration_mappings};
+
+/*
+ * Benchmark of the fastcall registration process of a function without
+ * additional mappings for different numbers of already registered fastcalls.
+ */
+static int benchmark_registration_sweep(Controller &controller,
+                                        Params const &params) {
+  fce::ioctl_args args;
+  fce::FileDescriptor fd{};
+  fce::ManyFastcalls fastcalls{params.sweep.fill, 0};
+
+  for (auto count : params.sweep.counts) {
+    if (!prepare_sweep_point(fastcalls, count, &fd))
+      break;
+
+    controller.restart(count);
+    while (controller.cont()) {
+      controller.start_timer();
+      fd.io(fce::IOCTL_NOOP, &args);
+      controller.end_timer();
+
+      fce::deregister(args);
+    }
+  }
+
+  return 0;
+}
+static Registrar registration_sweep_registrar{
+    "registration-sweep", Kind::KEYED, benchmark_registration_sweep};
 
 /*
  * Benchmark of the fastcall deregistration process of a function without
@@ -77,6 +167,8 @@ static int benchmark_deregistration_minimal(Controller &controller) {
 
   return 0;
 }
+static Registrar deregistration_minimal_registrar{
+    "deregistration-minimal", Kind::SAMPLES, benchmark_deregistration_minimal};
 
 /*
  * Benchmark of the fastcall deregistration process of a function with
@@ -96,6 +188,38 @@ static int benchmark_deregistration_mappings(Controller &controller) {
 
   return 0;
 }
+static Registrar deregistration_mappings_registrar{
+    "deregistration-mappings", Kind::SAMPLES,
+    benchmark_deregistration_mappings};
+
+/*
+ * Benchmark of the fastcall deregistration process of a function without
+ * additional mappings for different numbers of other registered fastcalls.
+ */
+static int benchmark_deregistration_sweep(Controller &controller,
+                                          Params const &params) {
+  fce::ioctl_args args;
+  fce::FileDescriptor fd{};
+  fce::ManyFastcalls fastcalls{params.sweep.fill, 0};
+
+  for (auto count : params.sweep.counts) {
+    if (!prepare_sweep_point(fastcalls, count, &fd))
+      break;
+
+    controller.restart(count);
+    while (controller.cont()) {
+      fd.io(fce::IOCTL_NOOP, &args);
+
+      controller.start_timer();
+      fce::deregister(args);
+      controller.end_timer();
+    }
+  }
+
+  return 0;
+}
+static Registrar deregistration_sweep_registrar{
+    "deregistration-sweep", Kind::KEYED, benchmark_deregistration_sweep};
 
 /*
  * Benchmark of a simple fork.
@@ -111,7 +235,7 @@ static int benchmark_fork_simple(Controller &controller) {
       std::cerr << "fork failed: " << std::strerror(errno) << '\n';
       return 1;
     } else if (pid == 0)
-      exit(0);
+      _exit(0);
     controller.end_timer();
 
     if (waitpid(pid, nullptr, 0) < 0) {
@@ -122,6 +246,8 @@ static int benchmark_fork_simple(Controller &controller) {
 
   return 0;
 }
+static Registrar fork_simple_registrar{"fork-simple", Kind::SAMPLES,
+                                       benchmark_fork_simple};
 
 /*
  * Benchmark of a fork of a process which registered many fastcalls.
@@ -135,6 +261,30 @@ static int benchmark_fork_fastcall(Controller &controller) {
 
   return 0;
 }
+static Registrar fork_fastcall_registrar{"fork-fastcall", Kind::SAMPLES,
+                                         benchmark_fork_fastcall};
+
+/*
+ * Benchmark of a fork of a process for different numbers of registered
+ * fastcalls.
+ */
+static int benchmark_fork_sweep(Controller &controller, Params const &params) {
+  fce::ManyFastcalls fastcalls{params.sweep.fill, 0};
+
+  for (auto count : params.sweep.counts) {
+    if (!prepare_sweep_point(fastcalls, count))
+      break;
+
+    controller.restart(count);
+    int err = benchmark_fork_simple(controller);
+    if (err)
+      return err;
+  }
+
+  return 0;
+}
+static Registrar fork_sweep_registrar{"fork-sweep", Kind::KEYED,
+                                      benchmark_fork_sweep};
 
 /*
  * Benchmark of a simple vfork.
@@ -162,6 +312,8 @@ static int benchmark_vfork_simple(Controller &controller) {
 
   return 0;
 }
+static Registrar vfork_simple_registrar{"vfork-simple", Kind::SAMPLES,
+                                        benchmark_vfork_simple};
 
 /*
  * Benchmark of a vfork of a process which registered many fastcalls.
@@ -175,40 +327,140 @@ static int benchmark_vfork_fastcall(Controller &controller) {
 
   return 0;
 }
+static Registrar vfork_fastcall_registrar{"vfork-fastcall", Kind::SAMPLES,
+                                          benchmark_vfork_fastcall};
+
+/*
+ * Benchmark of a vfork of a process for different numbers of registered
+ * fastcalls.
+ */
+static int benchmark_vfork_sweep(Controller &controller,
+                                Params const &params) {
+  fce::ManyFastcalls fastcalls{params.sweep.fill, 0};
+
+  for (auto count : params.sweep.counts) {
+    if (!prepare_sweep_point(fastcalls, count))
+      break;
+
+    controller.restart(count);
+    int err = benchmark_vfork_simple(controller);
+    if (err)
+      return err;
+  }
+
+  return 0;
+}
+static Registrar vfork_sweep_registrar{"vfork-sweep", Kind::KEYED,
+                                       benchmark_vfork_sweep};
+
+/*
+ * The churn benchmarks run their own threads and print summaries.
+ */
+static Registrar churn_minimal_registrar{
+    "churn-minimal", Kind::STANDALONE, [](Params const &params) {
+      return churn::run<fce::ioctl_args>(params.churn, fce::IOCTL_NOOP);
+    }};
+static Registrar churn_mappings_registrar{
+    "churn-mappings", Kind::STANDALONE, [](Params const &params) {
+      return churn::run<fce::array_args>(params.churn, fce::IOCTL_ARRAY);
+    }};
+
+/*
+ * Run one sample-based benchmark with its own output.
+ */
+static int run_samples(registry::Benchmark<Controller, Params> const &benchmark,
+                       Params const &params, options::Opt const &opt,
+                       bool multiple) {
+  bool keyed = benchmark.kind == Kind::KEYED;
+  std::vector<std::string> columns{"nanos"};
+  std::uint64_t rows = opt.bench_iters;
+  if (keyed) {
+    columns.insert(columns.begin(), "fastcalls");
+    rows *= params.sweep.counts.size();
+  }
+
+  auto trace = registry::trace_path(opt.trace, benchmark.name, multiple);
+  samples::Output output{trace::make_header(benchmark.name, 0, columns), rows,
+                         {opt.record, opt.summary, trace}, keyed};
+  Controller controller{opt.warmup_iters, opt.bench_iters, output, keyed};
+
+  int err = benchmark.samples(controller, params);
+  controller.finish();
+  return err;
+}
 
 int main(int argc, char *argv[]) {
-  auto opt = options::parse_cmd(argc, argv);
+  namespace po = boost::program_options;
+
+  Params params;
+  std::string fill;
+  std::string default_sweep;
+  for (auto count : DEFAULT_SWEEP)
+    default_sweep += (default_sweep.empty() ? "" : " ") + std::to_string(count);
+  po::options_description desc("Misc options");
+  desc.add_options()(
+      "sweep,S",
+      po::value<std::vector<std::uint64_t>>(&params.sweep.counts)
+          ->multitoken()
+          ->default_value(DEFAULT_SWEEP, default_sweep),
+      "numbers of registered fastcalls for sweep benchmarks");
+  desc.add_options()("fill",
+                     po::value<std::string>(&fill)->default_value("array"),
+                     "kind of registered fastcalls for sweep benchmarks "
+                     "(noop, array or mixed)");
+  desc.add_options()(
+      "threads,n",
+      po::value<unsigned int>(&params.churn.threads)->default_value(0),
+      "number of threads for churn benchmarks (0 for all CPUs)");
+  desc.add_options()(
+      "duration,d",
+      po::value<double>(&params.churn.duration)->default_value(1),
+      "seconds to run churn benchmarks");
+  auto opt = options::parse_cmd(argc, argv, desc);
+
+  std::vector<registry::Benchmark<Controller, Params> const *> selected;
+  try {
+    selected = registry::select<Controller, Params>(opt.benchmarks);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  if (opt.list) {
+    registry::list(std::cout, selected);
+    return 0;
+  }
+
+#ifdef FASTCALL_EMULATION
+  std::cerr << "fastcall backend: " << fce::BACKEND
+            << ", results exclude the kernel mechanism" << std::endl;
+#endif
 
-  Controller controller{opt.warmup_iters, opt.bench_iters};
+  env::print(std::cout, env::fingerprint());
+
+  int err = 0;
   try {
-    auto &benchmark = opt.benchmark;
-
-    if (benchmark == "noop")
-      benchmark_noop(controller);
-    else if (benchmark == "registration-minimal")
-      return benchmark_registration_minimal(controller);
-    else if (benchmark == "registration-mappings")
-      return benchmark_registration_mappings(controller);
-    else if (benchmark == "deregistration-minimal")
-      return benchmark_deregistration_minimal(controller);
-    else if (benchmark == "deregistration-mappings")
-      return benchmark_deregistration_mappings(controller);
-    else if (benchmark == "fork-simple")
-      return benchmark_fork_simple(controller);
-    else if (benchmark == "fork-fastcall")
-      return benchmark_fork_fastcall(controller);
-    else if (benchmark == "vfork-simple")
-      return benchmark_vfork_simple(controller);
-    else if (benchmark == "vfork-fastcall")
-      return benchmark_vfork_fastcall(controller);
-    else {
-      std::cerr << "unknown benchmark " << benchmark << '\n';
-      return 1;
+    params.sweep.fill = fce::parse_fill(fill);
+
+    bool multiple = selected.size() > 1;
+    for (auto benchmark : selected) {
+      if (multiple)
+        registry::print_tag(std::cout, benchmark->name);
+
+      if (benchmark->kind == Kind::STANDALONE)
+        err = benchmark->standalone(params);
+      else
+        err = run_samples(*benchmark, params, opt, multiple);
+      if (err)
+        break;
     }
   } catch (fce::Error &e) {
     std::cerr << e.what() << '\n';
     return 1;
+  } catch (std::system_error &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
   }
 
-  return 0;
+  return err;
 }
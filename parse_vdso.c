@@ -13,6 +13,9 @@
  *
  * This code is tested on x86.  In principle it should work on any
  * architecture that has a vDSO.
+ *
+ * Modified to also resolve symbols through DT_GNU_HASH, as vDSOs may be
+ * linked without a SysV hash table.
  */
 
 #include <stdbool.h>
@@ -48,6 +51,10 @@ static struct vdso_info
 	ELF(Word) *bucket, *chain;
 	ELF(Word) nbucket, nchain;
 
+	/* GNU hash table, used instead of the SysV one if present */
+	ELF(Word) *gnu_bucket, *gnu_chain;
+	ELF(Word) gnu_nbucket, gnu_symoffset;
+
 	/* Version table */
 	ELF(Versym) *versym;
 	ELF(Verdef) *verdef;
@@ -67,6 +74,16 @@ static unsigned long elf_hash(const unsigned char *name)
 	return h;
 }
 
+/* The DJB hash used by DT_GNU_HASH. */
+static uint32_t gnu_hash(const char *name)
+{
+	const unsigned char *s = (const unsigned char *)name;
+	uint32_t h = 5381;
+	while (*s)
+		h = h * 33 + *s++;
+	return h;
+}
+
 void vdso_init_from_sysinfo_ehdr(uintptr_t base)
 {
 	size_t i;
@@ -107,7 +124,7 @@ void vdso_init_from_sysinfo_ehdr(uintptr_t base)
 	/*
 	 * Fish out the useful bits of the dynamic table.
 	 */
-	ELF(Word) *hash = 0;
+	ELF(Word) *hash = 0, *gnu = 0;
 	vdso_info.symstrings = 0;
 	vdso_info.symtab = 0;
 	vdso_info.versym = 0;
@@ -129,6 +146,11 @@ void vdso_init_from_sysinfo_ehdr(uintptr_t base)
 				((uintptr_t)dyn[i].d_un.d_ptr
 				 + vdso_info.load_offset);
 			break;
+		case DT_GNU_HASH:
+			gnu = (ELF(Word) *)
+				((uintptr_t)dyn[i].d_un.d_ptr
+				 + vdso_info.load_offset);
+			break;
 		case DT_VERSYM:
 			vdso_info.versym = (ELF(Versym) *)
 				((uintptr_t)dyn[i].d_un.d_ptr
@@ -141,17 +163,36 @@ void vdso_init_from_sysinfo_ehdr(uintptr_t base)
 			break;
 		}
 	}
-	if (!vdso_info.symstrings || !vdso_info.symtab || !hash)
+	if (!vdso_info.symstrings || !vdso_info.symtab || (!hash && !gnu))
 		return;  /* Failed */
 
 	if (!vdso_info.verdef)
 		vdso_info.versym = 0;
 
-	/* Parse the hash table header. */
-	vdso_info.nbucket = hash[0];
-	vdso_info.nchain = hash[1];
-	vdso_info.bucket = &hash[2];
-	vdso_info.chain = &hash[vdso_info.nbucket + 2];
+	/* Parse the hash table headers. */
+	vdso_info.bucket = 0;
+	if (hash) {
+		vdso_info.nbucket = hash[0];
+		vdso_info.nchain = hash[1];
+		vdso_info.bucket = &hash[2];
+		vdso_info.chain = &hash[vdso_info.nbucket + 2];
+	}
+
+	vdso_info.gnu_bucket = 0;
+	if (gnu) {
+		/*
+		 * nbucket, symoffset, bloom_size and bloom_shift are
+		 * followed by the bloom filter of ELF class sized words,
+		 * the buckets and the chain of hash values.  The bloom
+		 * filter is skipped, the buckets are just as cheap.
+		 */
+		vdso_info.gnu_nbucket = gnu[0];
+		vdso_info.gnu_symoffset = gnu[1];
+		vdso_info.gnu_bucket = (ELF(Word) *)
+			((ELF(Addr) *)&gnu[4] + gnu[2]);
+		vdso_info.gnu_chain = &vdso_info.gnu_bucket[gnu[0]]
+			- vdso_info.gnu_symoffset;
+	}
 
 	/* That's all we need. */
 	vdso_info.valid = true;
@@ -195,38 +236,67 @@ static bool vdso_match_version(ELF(Versym) ver,
 		&& !strcmp(name, vdso_info.symstrings + aux->vda_name);
 }
 
+static bool vdso_match_sym(ELF(Word) index, const char *name,
+			   const char *version, ELF(Word) ver_hash)
+{
+	ELF(Sym) *sym = &vdso_info.symtab[index];
+
+	/* Check for a defined global or weak function w/ right name. */
+	if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC)
+		return false;
+	if (ELF64_ST_BIND(sym->st_info) != STB_GLOBAL &&
+	    ELF64_ST_BIND(sym->st_info) != STB_WEAK)
+		return false;
+	if (sym->st_shndx == SHN_UNDEF)
+		return false;
+	if (strcmp(name, vdso_info.symstrings + sym->st_name))
+		return false;
+
+	/* Check symbol version. */
+	if (vdso_info.versym
+	    && !vdso_match_version(vdso_info.versym[index],
+				   version, ver_hash))
+		return false;
+
+	return true;
+}
+
 void *vdso_sym(const char *version, const char *name)
 {
 	unsigned long ver_hash;
+	ELF(Word) chain;
 	if (!vdso_info.valid)
 		return 0;
 
 	ver_hash = elf_hash(version);
-	ELF(Word) chain = vdso_info.bucket[elf_hash(name) % vdso_info.nbucket];
-
-	for (; chain != STN_UNDEF; chain = vdso_info.chain[chain]) {
-		ELF(Sym) *sym = &vdso_info.symtab[chain];
-
-		/* Check for a defined global or weak function w/ right name. */
-		if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC)
-			continue;
-		if (ELF64_ST_BIND(sym->st_info) != STB_GLOBAL &&
-		    ELF64_ST_BIND(sym->st_info) != STB_WEAK)
-			continue;
-		if (sym->st_shndx == SHN_UNDEF)
-			continue;
-		if (strcmp(name, vdso_info.symstrings + sym->st_name))
-			continue;
-
-		/* Check symbol version. */
-		if (vdso_info.versym
-		    && !vdso_match_version(vdso_info.versym[chain],
-					   version, ver_hash))
-			continue;
-
-		return (void *)(vdso_info.load_offset + sym->st_value);
+
+	if (vdso_info.gnu_bucket) {
+		/*
+		 * The chain holds the hashes of all symbols of a bucket
+		 * with the lowest bit marking the last one.
+		 */
+		uint32_t h = gnu_hash(name);
+		chain = vdso_info.gnu_bucket[h % vdso_info.gnu_nbucket];
+		if (chain < vdso_info.gnu_symoffset)
+			return 0;
+
+		for (;; chain++) {
+			uint32_t h2 = vdso_info.gnu_chain[chain];
+			if ((h | 1) == (h2 | 1)
+			    && vdso_match_sym(chain, name, version, ver_hash))
+				return (void *)(vdso_info.load_offset
+						+ vdso_info.symtab[chain].st_value);
+			if (h2 & 1)
+				return 0;
+		}
 	}
 
+	chain = vdso_info.bucket[elf_hash(name) % vdso_info.nbucket];
+	for (; chain != STN_UNDEF; chain = vdso_info.chain[chain])
+		if (vdso_match_sym(chain, name, version, ver_hash))
+			return (void *)(vdso_info.load_offset
+					+ vdso_info.symtab[chain].st_value);
+
 	return 0;
 }
 
@@ -3,20 +3,28 @@
 #ifdef __aarch64__
 
 #include "compiler.hpp"
+#include "env.hpp"
+#include "options.hpp"
 #include "os.hpp"
 #include "syscall.hpp"
+#include "trace.hpp"
 
 #include <array>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 #include <sys/mman.h>
 #include <unistd.h>
 
 #define SETW std::setw(12)
-#define CETW ',' << std::setw(12)
 
 typedef std::array<std::uint64_t, 13> Measurements;
 
+static const std::vector<std::string> COLUMNS{
+    "start", "overhead", "svc", "tramp_entry", "sp_overflow", "entry",
+    "el0_svc", "func_entry", "func_exit", "finish", "restore", "tramp_exit",
+    "eret"};
+
 static constexpr std::size_t SVC = 2;
 static constexpr std::size_t TRAMP_EXIT = 11;
 
@@ -69,18 +77,42 @@ static Measurements measure() {
   return measurements;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  auto opt = options::parse_syscall_cmd(argc, argv, ITERATIONS);
   os::assert_kernel(os::RELEASE_SYSCALL_BENCH);
   os::fix_cpu();
 
-  std::cout << SETW << "start" << CETW << "overhead" << CETW << "svc" << CETW
-            << "tramp_entry" << CETW << "sp_overflow" << CETW << "entry" << CETW
-            << "el0_svc" << CETW << "func_entry" << CETW << "func_exit" << CETW
-            << "finish" << CETW << "restore" << CETW << "tramp_exit" << CETW
-            << "eret" << std::endl;
-  for (std::size_t i = 0; i < ITERATIONS; i++) {
+  std::optional<trace::Writer> writer;
+  std::optional<stages::Aggregate> aggregate;
+  if (!opt.trace.empty())
+    writer.emplace(opt.trace, trace::make_header("syscall", 64, COLUMNS),
+                   opt.bench_iters);
+  else
+    env::print(std::cout, env::fingerprint());
+  if (opt.summary)
+    aggregate.emplace(COLUMNS);
+  else if (!writer) {
+    bool first = true;
+    for (auto const &column : COLUMNS) {
+      if (first)
+        first = false;
+      else
+        std::cout << ',';
+      std::cout << SETW << column;
+    }
+    std::cout << std::endl;
+  }
+
+  for (std::uint64_t i = 0; i < opt.bench_iters; i++) {
     Measurements measurements = measure();
 
+    if (writer)
+      writer->write(measurements.data());
+    if (aggregate)
+      aggregate->add(measurements.data());
+    if (writer || aggregate)
+      continue;
+
     bool first = true;
     for (auto const &cycles : measurements) {
       if (first)
@@ -92,6 +124,9 @@ int main() {
     std::cout << std::endl;
   }
 
+  if (aggregate)
+    aggregate->print(std::cout);
+
   return 0;
 }
 
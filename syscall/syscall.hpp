@@ -2,11 +2,80 @@
 
 #pragma once
 
+#include "stats.hpp"
+#include <cstdint>
 #include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
 
 #ifndef SYSCALL_ITERS
 #define SYSCALL_ITERS 10000
 #endif
 
+/* Default number of iterations, can be changed with --iter */
 static constexpr std::size_t ITERATIONS = SYSCALL_ITERS;
 static constexpr long SYS_BENCH = 445;
+
+/* Tolerated number of retried iterations per requested iteration */
+static constexpr std::uint64_t MAX_RETRIES = 100;
+
+namespace stages {
+
+/* Column holding the overhead of a single probe */
+static constexpr std::size_t OVERHEAD = 1;
+
+/*
+ * Per-stage statistics of the cumulative probe measurements in constant
+ * memory.
+ *
+ * A stage is the interval between two consecutive probes, starting with the
+ * overhead probe. Every stage includes the cost of one probe, so the median
+ * of the overhead column is subtracted from the reported statistics.
+ */
+class Aggregate {
+public:
+  explicit Aggregate(std::vector<std::string> const &columns)
+      : columns{columns}, summaries(columns.size()) {}
+
+  /*
+   * Add the cumulative measurements of one iteration.
+   */
+  void add(std::uint64_t const *measurements) {
+    summaries[OVERHEAD].add(measurements[OVERHEAD]);
+    for (std::size_t i = OVERHEAD + 1; i < columns.size(); i++) {
+      // Skipped probes might repeat the previous value.
+      std::uint64_t delta = measurements[i] >= measurements[i - 1]
+                                ? measurements[i] - measurements[i - 1]
+                                : 0;
+      summaries[i].add(delta);
+    }
+  }
+
+  /*
+   * Print the overhead-corrected statistics of every stage as CSV.
+   */
+  void print(std::ostream &out) const {
+    auto const &overhead = summaries[OVERHEAD].histogram();
+    double median = overhead.percentile(50);
+
+    out << "# minus the " << columns[OVERHEAD] << " median of " << median
+        << " per stage\n";
+    out << "stage,count,median,p99,mean,stddev\n";
+    for (std::size_t i = OVERHEAD + 1; i < columns.size(); i++) {
+      auto const &hist = summaries[i].histogram();
+      auto const &moments = summaries[i].get_moments();
+      out << columns[i - 1] << "->" << columns[i] << ',' << hist.count()
+          << ',' << hist.percentile(50) - median << ','
+          << hist.percentile(99) - median << ',' << moments.mean() - median
+          << ',' << moments.stddev() << '\n';
+    }
+    out.flush();
+  }
+
+private:
+  std::vector<std::string> columns;
+  std::vector<stats::Summary> summaries;
+};
+
+} // namespace stages
@@ -3,15 +3,19 @@
 #ifdef __x86_64__
 
 #include "compiler.hpp"
+#include "env.hpp"
+#include "options.hpp"
 #include "os.hpp"
 #include "perf.hpp"
 #include "syscall.hpp"
+#include "trace.hpp"
 
 #include <array>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
 #include <linux/perf_event.h>
+#include <optional>
 #include <stdexcept>
 #include <sys/mman.h>
 #include <sys/syscall.h>
@@ -19,10 +23,14 @@
 #include <x86intrin.h>
 
 #define SETW std::setw(11)
-#define CETW ',' << std::setw(11)
 
 typedef std::array<std::uint64_t, 13> Measurements;
 
+static const std::vector<std::string> COLUMNS{
+    "start", "overhead", "sycall", "swapgs_k", "cr3_k", "push_regs",
+    "func_entry", "func_exit", "ret_checks", "pop_regs", "cr3_u", "swapgs_u",
+    "sysret"};
+
 struct SeqlockError : public std::runtime_error {
   SeqlockError() : std::runtime_error{"sequence lock changed"} {}
 };
@@ -85,25 +93,75 @@ static Measurements measure(perf_event_mmap_page const *pc) {
   return measurements;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+
+  std::string event_name;
+  po::options_description desc("x86 options");
+  desc.add_options()(
+      "event,e", po::value<std::string>(&event_name)->default_value("cycles"),
+      "perf event read at every probe, e.g. instructions, dTLB-load-misses, "
+      "iTLB-load-misses, L1-icache-load-misses or branch-misses");
+  auto opt = options::parse_syscall_cmd(argc, argv, ITERATIONS, desc);
+
+  perf::Event event;
+  try {
+    event = perf::find_event(event_name);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
   os::assert_kernel(os::RELEASE_SYSCALL_BENCH);
 
-  int fd = perf::initialize();
+  int fd = perf::initialize(event);
   auto pc = perf::mmap(fd);
 
-  std::cout << SETW << "start" << CETW << "overhead" << CETW << "sycall" << CETW
-            << "swapgs_k" << CETW << "cr3_k" << CETW << "push_regs" << CETW
-            << "func_entry" << CETW << "func_exit" << CETW << "ret_checks"
-            << CETW << "pop_regs" << CETW << "cr3_u" << CETW << "swapgs_u"
-            << CETW << "sysret" << std::endl;
-  for (std::size_t i = 0; i < ITERATIONS; i++) {
+  std::optional<trace::Writer> writer;
+  std::optional<stages::Aggregate> aggregate;
+  if (!opt.trace.empty()) {
+    auto header = trace::make_header("syscall", pc->pmc_width, COLUMNS);
+    header.environment.emplace_back("event", event.name);
+    writer.emplace(opt.trace, header, opt.bench_iters);
+  } else {
+    env::print(std::cout, env::fingerprint());
+    std::cout << "# event: " << event.name << '\n';
+  }
+  if (opt.summary)
+    aggregate.emplace(COLUMNS);
+  else if (!writer) {
+    bool first = true;
+    for (auto const &column : COLUMNS) {
+      if (first)
+        first = false;
+      else
+        std::cout << ',';
+      std::cout << SETW << column;
+    }
+    std::cout << std::endl;
+  }
+
+  // Iterations interrupted by perf updates are repeated.
+  std::uint64_t retries = 0;
+  for (std::uint64_t i = 0; i < opt.bench_iters;) {
     Measurements measurements;
     try {
       measurements = measure(pc);
     } catch (SeqlockError const &err) {
-      std::cerr << err.what() << std::endl;
+      if (++retries > MAX_RETRIES * (i + 1)) {
+        std::cerr << err.what() << " too often" << std::endl;
+        return 1;
+      }
       continue;
     }
+    i++;
+
+    if (writer)
+      writer->write(measurements.data());
+    if (aggregate)
+      aggregate->add(measurements.data());
+    if (writer || aggregate)
+      continue;
 
     bool first = true;
     for (auto const &cycles : measurements) {
@@ -116,6 +174,11 @@ int main() {
     std::cout << std::endl;
   }
 
+  if (aggregate)
+    aggregate->print(std::cout);
+  if (!writer)
+    std::cout << "# seqlock retries: " << retries << std::endl;
+
   return 0;
 }
 
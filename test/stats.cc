@@ -0,0 +1,44 @@
+/*
+ * Checks of the streaming statistics, exits with a non-zero status on
+ * failure.
+ */
+
+#include "stats.hpp"
+#include <cstdint>
+#include <iostream>
+#include <limits>
+
+static int failures = 0;
+
+static void check(bool ok, char const *what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+int main() {
+  auto top = std::numeric_limits<std::uint64_t>::max();
+
+  stats::Histogram histogram;
+  histogram.add(1);
+  histogram.add(std::uint64_t{1} << 63);
+  histogram.add(top);
+  check(histogram.count() == 3, "count with values of 2^63 and above");
+  check(histogram.max() == top, "max of UINT64_MAX");
+  check(histogram.percentile(100) == top, "100th percentile of UINT64_MAX");
+  check(histogram.percentile(0) == 1, "0th percentile");
+
+  stats::Histogram exact;
+  for (std::uint64_t value = 1; value <= 100; value++)
+    exact.add(value);
+  check(exact.percentile(50) == 50, "median of exact values");
+  check(exact.percentile(99) == 99, "p99 of exact values");
+
+  stats::Histogram merged;
+  merged.merge(histogram);
+  check(merged.count() == 3 && merged.percentile(100) == top,
+        "merge of values of 2^63 and above");
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Checks of the binary trace format, exits with a non-zero status on
+ * failure.
+ */
+
+#include "trace.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static int failures = 0;
+
+static void check(bool ok, char const *what) {
+  if (!ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    failures++;
+  }
+}
+
+static trace::Header header(std::vector<std::string> const &columns) {
+  return trace::Header{"test", "cpu", "kernel", 0, columns, {}};
+}
+
+int main() {
+  char path[] = "/tmp/fastcall-test-trace-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return 1;
+  close(fd);
+
+  {
+    trace::Writer writer{path, header({"a", "b"}), 3};
+    for (std::uint64_t i = 0; i < 3; i++) {
+      std::uint64_t row[] = {i, 100 - i};
+      writer.write(row);
+    }
+  }
+  {
+    trace::Reader reader{path};
+    std::uint64_t rows = 0, sum = 0;
+    while (auto row = reader.next()) {
+      sum += row[0] + row[1];
+      rows++;
+    }
+    check(reader.get_rows() == 3 && rows == 3, "rows of a finished trace");
+    check(sum == 300, "values of a finished trace");
+  }
+
+  {
+    trace::Writer writer{path, header({}), 2};
+    writer.write(nullptr);
+    writer.write(nullptr);
+  }
+  {
+    trace::Reader reader{path};
+    std::uint64_t rows = 0;
+    while (reader.next() && rows < 10)
+      rows++;
+    check(rows == 2, "rows of a trace without columns");
+  }
+
+  // An open writer looks like one killed before close, with the rows not
+  // yet recorded and the preallocated file zero-padded.
+  {
+    trace::Writer writer{path, header({"a"}), 10};
+    std::uint64_t row[] = {1};
+    writer.write(row);
+    try {
+      trace::Reader reader{path};
+      check(false, "unfinished trace is rejected");
+    } catch (std::runtime_error const &) {
+    }
+  }
+
+  unlink(path);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,212 @@
+/*
+ * Converter from binary sample traces to CSV or JSON.
+ */
+
+#include "trace.hpp"
+#include <boost/program_options.hpp>
+#include <charconv>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+/* Size of the output buffer before it is flushed. */
+static const std::size_t FLUSH_SIZE = 1 << 16;
+
+/*
+ * Buffered writer to a stdio stream.
+ */
+class Out {
+public:
+  explicit Out(std::FILE *file) : file{file} { buf.reserve(2 * FLUSH_SIZE); }
+  ~Out() { flush(); }
+
+  Out &operator<<(char c) {
+    buf.push_back(c);
+    return *this;
+  }
+  Out &operator<<(std::string const &str) {
+    buf.append(str);
+    return *this;
+  }
+  Out &operator<<(std::uint64_t value) {
+    char tmp[20];
+    auto res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+    buf.append(tmp, res.ptr);
+    return *this;
+  }
+
+  /*
+   * Append a string as a quoted JSON string.
+   */
+  Out &json(std::string const &str) {
+    buf.push_back('"');
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        buf.push_back('\\');
+        buf.push_back(c);
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char tmp[7];
+        std::snprintf(tmp, sizeof(tmp), "\\u%04x", c);
+        buf.append(tmp);
+      } else
+        buf.push_back(c);
+    }
+    buf.push_back('"');
+    return *this;
+  }
+
+  void maybe_flush() {
+    if (buf.size() >= FLUSH_SIZE)
+      flush();
+  }
+
+  void flush() {
+    std::fwrite(buf.data(), 1, buf.size(), file);
+    buf.clear();
+  }
+
+private:
+  std::FILE *file;
+  std::string buf;
+};
+
+static void write_csv(trace::Reader &reader, Out &out) {
+  auto const &columns = reader.get_header().columns;
+  for (std::size_t i = 0; i < columns.size(); i++) {
+    if (i)
+      out << ',';
+    out << columns[i];
+  }
+  out << '\n';
+
+  while (auto row = reader.next()) {
+    for (std::size_t i = 0; i < columns.size(); i++) {
+      if (i)
+        out << ',';
+      out << row[i];
+    }
+    out << '\n';
+    out.maybe_flush();
+  }
+}
+
+static void write_json(trace::Reader &reader, Out &out) {
+  auto const &header = reader.get_header();
+  out << "{\"benchmark\":";
+  out.json(header.benchmark) << ",\"cpu\":";
+  out.json(header.cpu) << ",\"kernel\":";
+  out.json(header.kernel) << ",\"counter_width\":"
+                          << std::uint64_t{header.counter_width}
+                          << ",\"environment\":{";
+  for (std::size_t i = 0; i < header.environment.size(); i++) {
+    if (i)
+      out << ',';
+    out.json(header.environment[i].first) << ':';
+    out.json(header.environment[i].second);
+  }
+  out << "},\"columns\":[";
+  for (std::size_t i = 0; i < header.columns.size(); i++) {
+    if (i)
+      out << ',';
+    out.json(header.columns[i]);
+  }
+  out << "],\"samples\":[";
+
+  bool first = true;
+  while (auto row = reader.next()) {
+    out << (first ? "\n[" : ",\n[");
+    first = false;
+    for (std::size_t i = 0; i < header.columns.size(); i++) {
+      if (i)
+        out << ',';
+      out << row[i];
+    }
+    out << ']';
+    out.maybe_flush();
+  }
+  out << "]}\n";
+}
+
+static void write_info(trace::Reader &reader, Out &out) {
+  auto const &header = reader.get_header();
+  out << "benchmark: " << header.benchmark << '\n';
+  out << "cpu: " << header.cpu << '\n';
+  out << "kernel: " << header.kernel << '\n';
+  out << "counter width: " << std::uint64_t{header.counter_width} << '\n';
+  out << "rows: " << reader.get_rows() << '\n';
+  out << "columns:";
+  for (auto const &column : header.columns)
+    out << ' ' << column;
+  out << '\n';
+  if (!header.environment.empty())
+    out << "environment:\n";
+  for (auto const &[key, value] : header.environment)
+    out << "  " << key << ": " << value << '\n';
+}
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+
+  std::string format, input, output;
+  bool error = false;
+
+  po::options_description desc("Options");
+  desc.add_options()("help", "produce help message");
+  desc.add_options()("format,f",
+                     po::value<std::string>(&format)->default_value("csv"),
+                     "output format (csv, json or info)");
+  desc.add_options()("output,o", po::value<std::string>(&output),
+                     "output file instead of stdout");
+  desc.add_options()("input", po::value<std::string>(&input), "trace file");
+  po::positional_options_description pos;
+  pos.add("input", 1);
+
+  po::variables_map vm;
+  try {
+    auto parser =
+        po::command_line_parser(argc, argv).options(desc).positional(pos).run();
+    po::store(parser, vm);
+    po::notify(vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << '\n';
+    error = true;
+  }
+
+  if (error || vm.count("help") || !vm.count("input") ||
+      (format != "csv" && format != "json" && format != "info")) {
+    std::cerr << "Usage: " << argv[0] << " [options] <trace>\n\n";
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  std::FILE *file = stdout;
+  if (!output.empty()) {
+    file = std::fopen(output.c_str(), "w");
+    if (!file) {
+      std::perror("cannot open output file");
+      return 1;
+    }
+  }
+
+  try {
+    trace::Reader reader{input};
+    Out out{file};
+
+    if (format == "csv")
+      write_csv(reader, out);
+    else if (format == "json")
+      write_json(reader, out);
+    else
+      write_info(reader, out);
+  } catch (std::exception const &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+
+  if (file != stdout && std::fclose(file)) {
+    std::perror("cannot close output file");
+    return 1;
+  }
+
+  return 0;
+}